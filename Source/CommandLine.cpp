@@ -0,0 +1,162 @@
+//
+//  CommandLine.cpp
+//  RiffView_App
+//
+//  created by yu2924 on 2026-10-18
+//
+
+#include "CommandLine.h"
+#include "RiffDocument.h"
+#include "riffexport.h"
+#include "riffquery.h"
+#include <iostream>
+#if JUCE_WINDOWS
+#include <io.h>
+#include <fcntl.h>
+#include <cstdio>
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+static void loadDocument(RiffDocument& doc, const juce::File& path, const riffrw::RiffNode::DescendFilter& descendFilter = nullptr)
+{
+	if(!doc.loadContent(path, descendFilter)) juce::ConsoleApplication::fail("failed to load: " + path.getFullPathName() + ": " + doc.getLastError());
+}
+
+static riffrw::Query compileQuery(const juce::String& text)
+{
+	riffrw::Query query(text.toStdString());
+	if(!query.isValid()) juce::ConsoleApplication::fail("invalid query: " + juce::String(query.getError()));
+	return query;
+}
+
+// --export <query> <source> <destination> [--concat]
+static void performExport(const juce::ArgumentList& argsin)
+{
+	juce::ArgumentList args(argsin);
+	bool concatenate = args.removeOptionIfFound("--concat");
+	args.checkMinNumArguments(4);
+	riffrw::Query query = compileQuery(args[1].text);
+	juce::File srcpath = args[2].resolveAsFile();
+	juce::File dstpath = args[3].resolveAsFile();
+	RiffDocument doc;
+	loadDocument(doc, srcpath);
+	doc.expandLazyNodes(query.descendFilter());
+	std::vector<riffrw::ChunkExport::Item> items = riffrw::ChunkExport::selectItems(doc.getRootNode(), query);
+	std::unique_ptr<std::istream> istr = doc.openContentStream();
+	if(!istr) juce::ConsoleApplication::fail("failed to open: " + srcpath.getFullPathName());
+	bool ok = false;
+	if(concatenate)
+	{
+		std::fstream ostr(RiffDocument::toStdPath(dstpath), std::ios::out | std::ios::binary | std::ios::trunc);
+		ok = ostr.good() && riffrw::ChunkExport::exportToStream(*istr, items, ostr);
+	}
+	else
+	{
+		ok = riffrw::ChunkExport::exportToDirectory(*istr, items, RiffDocument::toStdPath(dstpath));
+	}
+	if(!ok) juce::ConsoleApplication::fail("failed to export to: " + dstpath.getFullPathName());
+	std::cout << items.size() << " chunks, " << riffrw::ChunkExport::totalSize(items) << " bytes exported" << std::endl;
+}
+
+// --query <query> <files...>
+static void performQuery(const juce::ArgumentList& args)
+{
+	args.checkMinNumArguments(3);
+	riffrw::Query query = compileQuery(args[1].text);
+	bool multiple = 3 < args.size();
+	for(int i = 2; i < args.size(); ++i)
+	{
+		juce::File srcpath = args[i].resolveAsFile();
+		RiffDocument doc;
+		// containers that cannot contain a match are not parsed at all
+		loadDocument(doc, srcpath, query.descendFilter());
+		doc.expandLazyNodes(query.descendFilter());
+		query.select(doc.getRootNode(), [&](const riffrw::RiffNode& n)
+		{
+			if(multiple) std::cout << srcpath.getFullPathName() << ": ";
+			std::cout << n.nodePath() << " (" << n.ckinfo.hdroffset << "-" << n.ckinfo.header.cksize << ")" << std::endl;
+		});
+	}
+}
+
+// --stats <files...>, "-" reads stdin
+static void performStats(const juce::ArgumentList& args)
+{
+	args.checkMinNumArguments(2);
+	riffrw::ChunkStats stats;
+	for(int i = 1; i < args.size(); ++i)
+	{
+		if(args[i].text == "-")
+		{
+#if JUCE_WINDOWS
+			_setmode(_fileno(stdin), _O_BINARY);
+#endif
+			if(!stats.readStream(std::cin)) std::cerr << "stdin: truncated or not a valid RIFF stream" << std::endl;
+			continue;
+		}
+		juce::File srcpath = args[i].resolveAsFile();
+		juce::String error;
+		if(!RiffDocument::scanStatistics(srcpath, stats, &error)) std::cerr << srcpath.getFullPathName() << ": " << error << std::endl;
+	}
+	stats.report(std::cout);
+}
+
+static void addCommands(juce::ConsoleApplication& app)
+{
+	app.addHelpCommand("--help|-h", "Usage:", true);
+	app.addCommand({ "--export", "--export <query> <source> <destination> [--concat]", "Exports the payloads of the matching chunks.",
+		"Each chunk is written to a file in the destination directory, or with --concat all chunks are concatenated into the destination file. "
+		"See --query for the query syntax.",
+		performExport });
+	app.addCommand({ "--query", "--query <query> <files...>", "Lists the matching chunks.",
+		"The query is a chunk path such as \"/RIFF.WAVE/data\" (from the root) or \"LIST.movi/00dc\" (at any depth). "
+		"\"//\" matches at any depth, \"{00dc,01wb}\" matches a set, path elements may contain the wildcards * and ?, "
+		"and each step may have predicates such as [size>4096], [offset<0x10000], [10] or [10:20] (index among the matching siblings).",
+		performQuery });
+	app.addCommand({ "--stats", "--stats <files...>", "Reports chunk statistics over the files, \"-\" reads a stream from stdin.",
+		"Counts, total, min, max and percentile sizes per chunk kind, header and padding bytes, nesting depth, "
+		"and the odd sized, missing pad and out of bounds anomalies, accumulated while parsing and merged over all files. "
+		"Files that fail to parse are counted and keep the statistics gathered up to the failure.",
+		performStats });
+}
+
+bool CommandLineIsHeadless(const juce::StringArray& args)
+{
+	if(args.isEmpty()) return false;
+	juce::ConsoleApplication app;
+	addCommands(app);
+	for(const juce::ConsoleApplication::Command& c : app.getCommands())
+	{
+		if(juce::StringArray::fromTokens(c.commandOption, "|", {}).contains(args[0])) return true;
+	}
+	return false;
+}
+
+#if JUCE_WINDOWS
+// the app is built for the GUI subsystem and starts without a console: write to the console it was launched from
+// streams redirected to a file or a pipe are inherited as they are and left alone
+static void attachParentConsole()
+{
+	if(!AttachConsole(ATTACH_PARENT_PROCESS)) return;
+	FILE* fp = nullptr;
+	if(_fileno(stdout) < 0) freopen_s(&fp, "CONOUT$", "w", stdout);
+	if(_fileno(stderr) < 0) freopen_s(&fp, "CONOUT$", "w", stderr);
+	if(_fileno(stdin) < 0) freopen_s(&fp, "CONIN$", "r", stdin);
+	std::cout.clear();
+	std::cerr.clear();
+	std::cin.clear();
+}
+#endif
+
+int CommandLinePerform(const juce::StringArray& args)
+{
+#if JUCE_WINDOWS
+	attachParentConsole();
+#endif
+	juce::ConsoleApplication app;
+	addCommands(app);
+	return app.findAndRunCommand(juce::ArgumentList(juce::File::getSpecialLocation(juce::File::currentExecutableFile).getFileName(), args));
+}
@@ -0,0 +1,14 @@
+//
+//  CommandLine.h
+//  RiffView_App
+//
+//  created by yu2924 on 2026-10-18
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// headless commands, performed instead of opening the window
+bool CommandLineIsHeadless(const juce::StringArray& args);
+int CommandLinePerform(const juce::StringArray& args);
@@ -7,6 +7,7 @@
 
 #include <JuceHeader.h>
 #include "MainComponent.h"
+#include "CommandLine.h"
 
 static const juce::LookAndFeel_V4::ColourScheme LightColourScheme =
 {
@@ -26,6 +27,7 @@ class MainWindow : public juce::DocumentWindow
 private:
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MainWindow)
 public:
+	std::function<void(MainWindow*)> onCloseRequested;
 	MainWindow(juce::String name)
 		: DocumentWindow(name, juce::Desktop::getInstance().getDefaultLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId), DocumentWindow::allButtons)
 	{
@@ -39,39 +41,177 @@ public:
 #endif
 		setVisible(true);
 	}
+	bool hasContent() const
+	{
+		return MainComponentHasContent(getContentComponent());
+	}
+	bool loadContent(const juce::File& path)
+	{
+		if(!MainComponentLoadContent(getContentComponent(), path)) return false;
+		setName(juce::JUCEApplication::getInstance()->getApplicationName() + " - " + path.getFileName());
+		return true;
+	}
 	virtual void closeButtonPressed() override
 	{
-		juce::JUCEApplication::getInstance()->systemRequestedQuit();
+		if(onCloseRequested) onCloseRequested(this);
+		else juce::JUCEApplication::getInstance()->systemRequestedQuit();
+	}
+};
+
+// carries the absolute file paths of a later launch to the running instance, which answers with an ack
+// an empty list (a launch without files) brings the running instance to the front
+class InstanceChannel : public juce::InterprocessConnection
+{
+private:
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(InstanceChannel)
+	bool listening = false;
+	juce::WaitableEvent acknowledged;
+	static juce::String getPipeName()
+	{
+		return getInstanceName() + "-pipe";
+	}
+public:
+	// per user, so that instances of different users on one machine do not see each other
+	static juce::String getInstanceName()
+	{
+		return juce::String(ProjectInfo::projectName) + "-" + juce::SystemStats::getLogonName();
+	}
+	std::function<void(const juce::Array<juce::File>&)> onFilesReceived;
+	explicit InstanceChannel(bool callbackOnMessageThread) : InterprocessConnection(callbackOnMessageThread) {}
+	virtual ~InstanceChannel() override
+	{
+		listening = false;
+		disconnect();
+	}
+	// the pipe serves one sender at a time and is recreated when it has gone
+	bool listen()
+	{
+		listening = true;
+		return createPipe(getPipeName(), -1, false);
+	}
+	bool send(const juce::Array<juce::File>& files)
+	{
+		for(int i = 0; !connectToPipe(getPipeName(), 1000); ++i)
+		{
+			if(10 <= i) return false;
+			juce::Thread::sleep(100);
+		}
+		juce::StringArray lines;
+		for(const juce::File& f : files) lines.add(f.getFullPathName());
+		juce::String text = lines.joinIntoString("\n");
+		bool ok = sendMessage(juce::MemoryBlock(text.toRawUTF8(), text.getNumBytesAsUTF8())) && acknowledged.wait(5000);
+		disconnect();
+		return ok;
+	}
+	virtual void connectionMade() override {}
+	virtual void connectionLost() override
+	{
+		if(listening) createPipe(getPipeName(), -1, false);
+	}
+	virtual void messageReceived(const juce::MemoryBlock& message) override
+	{
+		if(!listening) { acknowledged.signal(); return; }
+		juce::StringArray lines = juce::StringArray::fromLines(message.toString());
+		lines.removeEmptyStrings();
+		juce::Array<juce::File> files;
+		for(const juce::String& line : lines) files.add(juce::File(line));
+		// ack before opening, the sender must not wait for the files to be parsed
+		sendMessage(juce::MemoryBlock("\x06", 1));
+		if(onFilesReceived) juce::MessageManager::callAsync([callback = onFilesReceived, files]() { callback(files); });
 	}
 };
 
 class RiffViewApplication : public juce::JUCEApplication
 {
 private:
-	std::unique_ptr<MainWindow> mainWindow;
+	juce::OwnedArray<MainWindow> mainWindows;
+	std::unique_ptr<juce::InterProcessLock> instanceLock;
+	std::unique_ptr<InstanceChannel> instanceChannel;
+	MainWindow* createWindow()
+	{
+		MainWindow* w = mainWindows.add(new MainWindow(getApplicationName()));
+		if(1 < mainWindows.size()) w->setTopLeftPosition(mainWindows[mainWindows.size() - 2]->getPosition() + juce::Point<int>(32, 32));
+		w->onCloseRequested = [this](MainWindow* mw)
+		{
+			if(mainWindows.size() <= 1) { systemRequestedQuit(); return; }
+			juce::MessageManager::callAsync([this, mw]() { mainWindows.removeObject(mw); });
+		};
+		return w;
+	}
+	// relative paths resolve against the working directory of the process that was launched with them
+	static juce::Array<juce::File> resolveFiles(const juce::StringArray& args)
+	{
+		juce::Array<juce::File> files;
+		for(const juce::String& arg : args) files.add(juce::File::getCurrentWorkingDirectory().getChildFile(arg.unquoted()));
+		return files;
+	}
+	// each file opens in the first empty window, or in a new one; the parsed trees are shared in process by RiffDocument
+	void openFiles(const juce::Array<juce::File>& files)
+	{
+		if(files.isEmpty() && !mainWindows.isEmpty()) mainWindows.getLast()->toFront(true);
+		for(const juce::File& path : files)
+		{
+			if(!path.existsAsFile()) continue;
+			MainWindow* w = nullptr;
+			for(MainWindow* mw : mainWindows) { if(!mw->hasContent()) { w = mw; break; } }
+			if(!w) w = createWindow();
+			w->loadContent(path);
+			w->toFront(true);
+		}
+	}
 public:
 	RiffViewApplication() {}
 	virtual const juce::String getApplicationName() override { return ProjectInfo::projectName; }
 	virtual const juce::String getApplicationVersion() override { return ProjectInfo::versionString; }
+	// GUI launches hand their files to the running instance themselves, see InstanceChannel
 	virtual bool moreThanOneInstanceAllowed() override { return true; }
 	virtual void initialise(const juce::String&) override
 	{
+		juce::StringArray args = getCommandLineParameterArray();
+		if(CommandLineIsHeadless(args))
+		{
+			setApplicationReturnValue(CommandLinePerform(args));
+			quit();
+			return;
+		}
+		instanceLock = std::make_unique<juce::InterProcessLock>(InstanceChannel::getInstanceName());
+		if(!instanceLock->enter(0))
+		{
+			// another instance is running; if it does not answer, carry on as a standalone instance
+			if(InstanceChannel(false).send(resolveFiles(args))) { quit(); return; }
+			instanceLock.reset();
+		}
+		else
+		{
+			instanceChannel = std::make_unique<InstanceChannel>(true);
+			instanceChannel->onFilesReceived = [this](const juce::Array<juce::File>& files) { openFiles(files); };
+			instanceChannel->listen();
+		}
 		if(juce::LookAndFeel_V4* lf4 = dynamic_cast<juce::LookAndFeel_V4*>(&juce::LookAndFeel::getDefaultLookAndFeel()))
 		{
 			lf4->setColourScheme(LightColourScheme);
 		}
-		mainWindow.reset(new MainWindow(getApplicationName()));
+		createWindow();
+		openFiles(resolveFiles(args));
 	}
 	virtual void shutdown() override
 	{
-		mainWindow = nullptr;
+		instanceChannel.reset();
+		instanceLock.reset();
+		mainWindows.clear();
 	}
 	virtual void systemRequestedQuit() override
 	{
 		quit();
 	}
-	virtual void anotherInstanceStarted(const juce::String&) override
+	// file open requests from the OS (e.g. the macOS Finder) carry absolute paths
+	virtual void anotherInstanceStarted(const juce::String& commandLine) override
 	{
+		if(mainWindows.isEmpty()) return;
+		juce::StringArray args;
+		args.addTokens(commandLine, true);
+		args.removeEmptyStrings();
+		if(!args.isEmpty()) openFiles(resolveFiles(args));
 	}
 
 };
@@ -6,31 +6,35 @@
 //
 
 #include "MainComponent.h"
-#include "riffrw.h"
+#include "RiffDocument.h"
+#include "riffexport.h"
+#include "riffquery.h"
+#include "riffchunks.h"
+#include <unordered_set>
+#include <sstream>
 
 class RiffNodeTempFile : public juce::ReferenceCountedObject
 {
 protected:
 	juce::File tmpPath;
 	const riffrw::RiffNode* node;
-	RiffNodeTempFile(const juce::File& srcpath, const riffrw::RiffNode* n) : node(n)
+	RiffNodeTempFile(std::unique_ptr<std::istream> istr, const riffrw::RiffNode* n) : node(n)
 	{
 		juce::String fn(node->ckinfo.pathElement());
 		fn = fn.replaceCharacter(' ', '_');
 		tmpPath = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile(fn + ".riffck");
-		juce::FileInputStream istr(srcpath);
 		juce::FileOutputStream ostr(tmpPath);
-		if(istr.openedOk() && ostr.openedOk())
+		if(istr && ostr.openedOk())
 		{
 			ostr.setPosition(0);
 			ostr.truncate();
-			istr.setPosition(node->ckinfo.hdroffset + 8);
+			istr->seekg(node->ckinfo.hdroffset + 8);
 			std::array<char, 4096> buf;
 			uint32_t len = node->ckinfo.header.cksize, pos = 0;
 			while(pos < len)
 			{
 				uint32_t lseg = std::min(len - pos, (uint32_t)buf.size());
-				istr.read(buf.data(), lseg);
+				istr->read(buf.data(), lseg);
 				ostr.write(buf.data(), lseg);
 				pos += lseg;
 			}
@@ -46,63 +50,106 @@ public:
 		return tmpPath;
 	}
 	using Ptr = juce::ReferenceCountedObjectPtr<RiffNodeTempFile>;
-	static Ptr createInstance(const juce::File& srcpath, const riffrw::RiffNode* n)
+	static Ptr createInstance(std::unique_ptr<std::istream> istr, const riffrw::RiffNode* n)
 	{
-		return new RiffNodeTempFile(srcpath, n);
-	}
-};
-
-class RiffDocument
-{
-protected:
-	juce::File contentPath;
-	riffrw::RiffNode rootNode{};
-public:
-	RiffDocument()
-	{
-	}
-	void clearContent()
-	{
-		contentPath = {};
-		rootNode = {};
-	}
-	bool loadContent(const juce::File& path)
-	{
-		contentPath = {};
-		rootNode = {};
-		riffrw::RiffNode n = {};
-		if(!riffrw::RiffNode::readTreeFromFile(std::wstring(path.getFullPathName().toUTF16()), &n)) return false;
-		rootNode = n;
-		contentPath = path;
-		return true;
-	}
-	const juce::File& getContentPath() const
-	{
-		return contentPath;
-	}
-	const riffrw::RiffNode& getRootNode() const
-	{
-		return rootNode;
+		return new RiffNodeTempFile(std::move(istr), n);
 	}
 };
 
 // ================================================================================
 // HexViewPane
 
-class HexViewPane : public juce::Component
+class HexViewPane : public juce::Component, protected juce::AsyncUpdater
 {
 protected:
+	struct TileKey
+	{
+		uint32_t hdroffset;
+		int index;
+		int charHeight;
+		float scale;
+		bool operator==(const TileKey& o) const { return (hdroffset == o.hdroffset) && (index == o.index) && (charHeight == o.charHeight) && (scale == o.scale); }
+	};
+	struct Tile
+	{
+		TileKey key;
+		juce::Image image;
+	};
+	enum { TileRows = 64, ReadAheadTiles = 2, TileCacheBudget = 64 << 20 };
 	juce::Colour backgounrdColor{ 0xffffffff };
 	juce::Colour textColor{ 0xff000000 };
-	juce::File riffPath;
 	const riffrw::RiffNode* node = nullptr;
-	std::unique_ptr<juce::FileInputStream> inputStream;
+	std::unique_ptr<std::istream> inputStream;
 	juce::Font fixedFont;
 	int charHeight = 14;
 	int charWidth = 8;
 	int idealPaneWidth = 0;
 	float charAscent = 14;
 	bool contentTooLarge = false;
+	std::list<Tile> tileCache; // most recently used first
+	size_t tileCacheBytes = 0;
+	float readAheadScale = 1;
+	// the payload of the neighbour tiles is read by a worker with its own stream, the message thread only renders and blits
+	std::unique_ptr<std::istream> readAheadStream;
+	uint64_t readAheadOffset = 0;
+	uint32_t readAheadSize = 0;
+	juce::CriticalSection readAheadLock;
+	std::map<int, std::vector<uint8_t>> tileBytes; // guarded by readAheadLock, as are the three below
+	int readAheadFrom = 0, readAheadThru = -1;
+	bool readAheadRunning = false;
+	juce::ThreadPool readAheadPool{ 1 };
+	static std::vector<uint8_t> readTileBytes(std::istream& istr, uint64_t dataoffset, uint32_t datasize, int itile)
+	{
+		uint64_t pos = (uint64_t)itile * TileRows * 16;
+		std::vector<uint8_t> bytes((size_t)std::min<uint64_t>(TileRows * 16, (pos < datasize) ? (datasize - pos) : 0));
+		istr.clear();
+		istr.seekg((std::streamoff)(dataoffset + pos));
+		istr.read((char*)bytes.data(), bytes.size());
+		bytes.resize((size_t)istr.gcount());
+		return bytes;
+	}
+	// the worker: reads the missing tiles of the current range, which paint() may move meanwhile
+	void readAhead()
+	{
+		while(true)
+		{
+			int itile = -1;
+			{
+				const juce::ScopedLock lock(readAheadLock);
+				for(int i = readAheadFrom; (itile < 0) && (i <= readAheadThru); ++i) { if(!tileBytes.count(i)) itile = i; }
+				if(itile < 0) { readAheadRunning = false; return; }
+			}
+			std::vector<uint8_t> bytes = readTileBytes(*readAheadStream, readAheadOffset, readAheadSize, itile);
+			{
+				const juce::ScopedLock lock(readAheadLock);
+				tileBytes[itile] = std::move(bytes);
+			}
+			triggerAsyncUpdate();
+		}
+	}
+	void stopReadAhead()
+	{
+		{
+			const juce::ScopedLock lock(readAheadLock);
+			readAheadThru = -1;
+		}
+		readAheadPool.removeAllJobs(true, -1);
+		const juce::ScopedLock lock(readAheadLock);
+		readAheadRunning = false;
+		tileBytes.clear();
+	}
+	// the payload of a tile, read here if the worker has not read it yet
+	std::vector<uint8_t> getTileBytes(int itile)
+	{
+		{
+			const juce::ScopedLock lock(readAheadLock);
+			auto it = tileBytes.find(itile);
+			if(it != tileBytes.end()) return it->second;
+		}
+		std::vector<uint8_t> bytes = readTileBytes(*inputStream, node->ckinfo.hdroffset + 8, node->ckinfo.header.cksize, itile);
+		const juce::ScopedLock lock(readAheadLock);
+		return tileBytes.insert({ itile, std::move(bytes) }).first->second;
+	}
 public:
 	// columns: 00000000  00 11 22 33  44 55 66 77  88 99 aa bb  cc dd ee ff  cccccccccccccccc
 	std::function<void(const HexViewPane*)> onMouseDrag;
@@ -115,6 +162,11 @@ public:
 		charAscent = fixedFont.getAscent();
 		updatePaneSize();
 	}
+	virtual ~HexViewPane() override
+	{
+		cancelPendingUpdate();
+		stopReadAhead();
+	}
 	void updatePaneSize()
 	{
 		int64_t length = node ? node->ckinfo.header.cksize : 0;
@@ -128,22 +180,15 @@ public:
 		setSize(idealPaneWidth, height);
 		repaint();
 	}
-	virtual void paint(juce::Graphics& g) override
+	// draws the rows in the component coordinates, bytes holds the payload from rowfrom on
+	void renderRows(juce::Graphics& g, int rowfrom, int rowthru, const std::vector<uint8_t>& bytes)
 	{
-		// NOTE: it is an extremely easy implementation and requires more optimization
-		juce::Rectangle<int> rc = getLocalBounds();
-		juce::Rectangle<int> rcclip = g.getClipBounds();
-		g.setColour(backgounrdColor);
-		g.fillAll();
-		if(!node) return;
 		g.setColour(textColor);
 		g.setFont(fixedFont);
 		int ascent = (int)(charAscent + 1);
-		int64_t length = node ? node->ckinfo.header.cksize : 0;
-		int numrows = (int)((length + 15) / 16);
-		int rowfrom = rcclip.getY() / charHeight;
+		int numrows = getNumRows();
 		if(numrows <= rowfrom) return;
-		int rowthru = std::min(numrows - 1, rcclip.getBottom() / charHeight);
+		rowthru = std::min(numrows - 1, rowthru);
 		if(rowthru < rowfrom) return;
 		float ytop = (float)rowfrom * charHeight;
 		float ybottom = (float)(rowthru + 1) * charHeight;
@@ -153,15 +198,15 @@ public:
 			float xf = (float)(x * charWidth) + 0.5f;
 			g.drawDashedLine(juce::Line<float>(xf, ytop, xf, ybottom), dash, 2, 1, 0);
 		}
-		int64_t ckdataoffset = node->ckinfo.hdroffset + 8;
-		inputStream->setPosition(ckdataoffset + rowfrom * 16);
 		std::array<uint8_t, 16> buffer;
 		uint32_t cksize = node->ckinfo.header.cksize, ckpos = rowfrom * 16;
 		for(int row = rowfrom; row <= rowthru; ++row)
 		{
 			if(cksize <= ckpos) break;
 			int lrow = (int)std::min((uint32_t)16, cksize - ckpos);
-			inputStream->read(buffer.data(), lrow);
+			size_t ibyte = (size_t)(ckpos - rowfrom * 16);
+			if(bytes.size() < ibyte + lrow) break;
+			std::memcpy(buffer.data(), bytes.data() + ibyte, lrow);
 			int y = row * charHeight;
 			// col: offset
 			int xoff = 0;
@@ -186,6 +231,109 @@ public:
 			ckpos += lrow;
 		}
 	}
+	int getNumRows() const
+	{
+		int64_t length = node ? node->ckinfo.header.cksize : 0;
+		return (int)((length + 15) / 16);
+	}
+	// rendered row tiles
+	const juce::Image& getTile(int itile, float scale)
+	{
+		TileKey key = { node ? node->ckinfo.hdroffset : 0, itile, charHeight, scale };
+		for(auto it = tileCache.begin(); it != tileCache.end(); ++it)
+		{
+			if(it->key == key)
+			{
+				tileCache.splice(tileCache.begin(), tileCache, it);
+				return tileCache.front().image;
+			}
+		}
+		int cx = (int)std::ceil(idealPaneWidth * scale), cy = (int)std::ceil(TileRows * charHeight * scale);
+		juce::Image img(juce::Image::RGB, cx, cy, false);
+		{
+			juce::Graphics g(img);
+			g.addTransform(juce::AffineTransform::scale(scale));
+			g.setColour(backgounrdColor);
+			g.fillAll();
+			g.setOrigin(0, -itile * TileRows * charHeight);
+			renderRows(g, itile * TileRows, (itile + 1) * TileRows - 1, getTileBytes(itile));
+		}
+		tileCache.push_front({ key, img });
+		tileCacheBytes += (size_t)cx * cy * 3;
+		while((TileCacheBudget < tileCacheBytes) && (1 < tileCache.size()))
+		{
+			const juce::Image& imgold = tileCache.back().image;
+			tileCacheBytes -= (size_t)imgold.getWidth() * imgold.getHeight() * 3;
+			tileCache.pop_back();
+		}
+		return tileCache.front().image;
+	}
+	bool hasTile(int itile, float scale) const
+	{
+		TileKey key = { node ? node->ckinfo.hdroffset : 0, itile, charHeight, scale };
+		for(const auto& t : tileCache) { if(t.key == key) return true; }
+		return false;
+	}
+	void invalidateTiles()
+	{
+		cancelPendingUpdate();
+		stopReadAhead();
+		tileCache.clear();
+		tileCacheBytes = 0;
+		repaint();
+	}
+	virtual void paint(juce::Graphics& g) override
+	{
+		g.setColour(backgounrdColor);
+		g.fillAll();
+		if(!node) return;
+		int numrows = contentTooLarge ? 1 : getNumRows();
+		int numtiles = (numrows + TileRows - 1) / TileRows;
+		if(!numtiles) return;
+		juce::Rectangle<int> rcclip = g.getClipBounds();
+		int tileheight = TileRows * charHeight;
+		int tilefrom = std::max(0, rcclip.getY() / tileheight);
+		int tilethru = std::min(numtiles - 1, std::max(0, rcclip.getBottom() - 1) / tileheight);
+		float scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+		for(int itile = tilefrom; itile <= tilethru; ++itile)
+		{
+			const juce::Image& img = getTile(itile, scale);
+			g.drawImage(img, 0, itile * tileheight, idealPaneWidth, tileheight, 0, 0, img.getWidth(), img.getHeight());
+		}
+		// read ahead the neighbour tiles
+		readAheadScale = scale;
+		bool start = false;
+		{
+			const juce::ScopedLock lock(readAheadLock);
+			readAheadFrom = std::max(0, tilefrom - ReadAheadTiles);
+			readAheadThru = std::min(numtiles - 1, tilethru + ReadAheadTiles);
+			start = readAheadStream && !readAheadRunning;
+			if(start) readAheadRunning = true;
+		}
+		if(start) readAheadPool.addJob([this]() { readAhead(); });
+	}
+	// juce::AsyncUpdater
+	virtual void handleAsyncUpdate() override
+	{
+		// renders the tiles whose payload the worker has read, one per callback
+		int from, thru;
+		{
+			const juce::ScopedLock lock(readAheadLock);
+			from = readAheadFrom;
+			thru = readAheadThru;
+		}
+		for(int itile = from; itile <= thru; ++itile)
+		{
+			if(hasTile(itile, readAheadScale)) continue;
+			{
+				const juce::ScopedLock lock(readAheadLock);
+				if(!tileBytes.count(itile)) continue;
+			}
+			getTile(itile, readAheadScale);
+			triggerAsyncUpdate();
+			return;
+		}
+	}
 	virtual void mouseDrag(const juce:: MouseEvent&) override
 	{
 		if(!node) return;
@@ -193,20 +341,26 @@ public:
 	}
 	void clearRiffNode()
 	{
-		riffPath = {};
 		node = nullptr;
-		inputStream = nullptr;
 		contentTooLarge = false;
+		invalidateTiles();
 		updatePaneSize();
 	}
-	bool setRiffNode(const juce::File& path, const riffrw::RiffNode* n)
+	// the streams are kept across node selections, so that a compressed source keeps its decompressed blocks
+	// readahead is an independent stream on the same content, used by the read-ahead worker only
+	void setContentStream(std::unique_ptr<std::istream> str, std::unique_ptr<std::istream> readahead = nullptr)
 	{
 		clearRiffNode();
-		std::unique_ptr<juce::FileInputStream> str = std::make_unique<juce::FileInputStream>(path);
-		if(str->failedToOpen()) return false;
 		inputStream = std::move(str);
-		riffPath = path;
+		readAheadStream = std::move(readahead);
+	}
+	bool setRiffNode(const riffrw::RiffNode* n)
+	{
+		clearRiffNode();
+		if(!inputStream) return false;
 		node = n;
+		readAheadOffset = (uint64_t)n->ckinfo.hdroffset + 8;
+		readAheadSize = n->ckinfo.header.cksize;
 		updatePaneSize();
 		return true;
 	}
@@ -224,6 +378,82 @@ public:
 	}
 };
 
+// ================================================================================
+// DecodedFieldsPane
+
+class DecodedFieldsPane : public juce::Component
+{
+protected:
+	struct Field
+	{
+		juce::String name;
+		juce::String value;
+	};
+	std::vector<Field> fields;
+	juce::Font font;
+	int rowHeight = 18;
+	int nameWidth = 160;
+	template<typename V> static juce::String formatValue(const V& v)
+	{
+		if constexpr(std::is_same_v<V, std::string_view>) return "\"" + juce::String::createStringFromData(v.data(), (int)v.size()) + "\"";
+		else if constexpr(std::is_same_v<V, riffrw::FourCC>) return "'" + juce::String(v.toString()) + "'";
+		else if constexpr(std::is_signed_v<V>) return juce::String((juce::int64)v);
+		else return juce::String((juce::uint64)v) + " (0x" + juce::String::toHexString((juce::int64)v) + ")";
+	}
+public:
+	DecodedFieldsPane()
+	{
+		font = juce::Font(juce::Font::getDefaultMonospacedFontName(), 14.0f, juce::Font::plain);
+		updatePaneSize();
+	}
+	void updatePaneSize()
+	{
+		int width = 320;
+		if(juce::Viewport* vp = findParentComponentOfClass<juce::Viewport>()) width = std::max(vp->getMaximumVisibleWidth(), width);
+		setSize(width, std::max(rowHeight, (int)fields.size() * rowHeight));
+		repaint();
+	}
+	void clearFields()
+	{
+		fields.clear();
+		updatePaneSize();
+	}
+	// p/c is the leading part of the payload, the views clip their fields to it
+	void setFields(const riffrw::RiffNode& n, const void* p, size_t c)
+	{
+		fields.clear();
+		riffrw::ChunkViews::decodeFields(n, p, c, [this](std::string_view name, int index, auto value)
+		{
+			juce::String sname = juce::String::fromUTF8(name.data(), (int)name.size());
+			if(0 <= index) sname += "[" + juce::String(index) + "]";
+			fields.push_back({ sname, formatValue(value) });
+		});
+		updatePaneSize();
+	}
+	virtual void paint(juce::Graphics& g) override
+	{
+		g.fillAll(juce::Colours::white);
+		g.setFont(font);
+		juce::Rectangle<int> rcclip = g.getClipBounds();
+		int rowfrom = std::max(0, rcclip.getY() / rowHeight), rowthru = std::min((int)fields.size() - 1, rcclip.getBottom() / rowHeight);
+		if(fields.empty())
+		{
+			g.setColour(juce::Colours::grey);
+			g.drawText("no decoder for this chunk", 4, 0, getWidth() - 8, rowHeight, juce::Justification::centredLeft);
+			return;
+		}
+		for(int row = rowfrom; row <= rowthru; ++row)
+		{
+			const Field& fld = fields[(size_t)row];
+			int y = row * rowHeight;
+			g.setColour(juce::Colours::darkblue);
+			g.drawText(fld.name, 4, y, nameWidth - 8, rowHeight, juce::Justification::centredLeft);
+			g.setColour(juce::Colours::black);
+			g.drawText(fld.value, nameWidth, y, getWidth() - nameWidth - 4, rowHeight, juce::Justification::centredLeft);
+		}
+	}
+};
+
 // ================================================================================
 // RiffNodeTreeView
 
@@ -265,6 +495,7 @@ protected:
 public:
 	std::function<void(const RiffNodeTVItem*)> onSelectionChanged;
 	std::function<void(const RiffNodeTVItem*)> onMouseDrag;
+	std::function<void(RiffNodeTVItem*)> onOpened;
 	RiffNodeTVItem(const riffrw::RiffNode* n) : node(n) {}
 	const riffrw::RiffNode* getRiffNode() const { return node; }
 	virtual bool mightContainSubItems() override { return node->ckinfo.header.isContainer(); }
@@ -307,6 +538,10 @@ public:
 	{
 		if(onSelectionChanged) onSelectionChanged(this);
 	}
+	virtual void itemOpennessChanged(bool isNowOpen) override
+	{
+		if(isNowOpen && onOpened) onOpened(this);
+	}
 };
 
 class RiffNodeTreeView : public juce::TreeView
@@ -315,6 +550,141 @@ class RiffNodeTreeView : public juce::TreeView
 		virtual bool isInterestedInFileDrag(const juce::StringArray&) override { return false; }
 };
 
+// ================================================================================
+// ChunkExportThread
+
+class ChunkExportThread : public juce::ThreadWithProgressWindow
+{
+protected:
+	std::unique_ptr<std::istream> inputStream;
+	std::vector<riffrw::ChunkExport::Item> items;
+	juce::File destination;
+	bool concatenate;
+	bool succeeded = false;
+public:
+	ChunkExportThread(std::unique_ptr<std::istream> istr, const std::vector<riffrw::ChunkExport::Item>& its, const juce::File& dst, bool concat)
+		: juce::ThreadWithProgressWindow("exporting chunks...", true, true), inputStream(std::move(istr)), items(its), destination(dst), concatenate(concat)
+	{
+	}
+	virtual void run() override
+	{
+		uint64_t total = std::max((uint64_t)1, riffrw::ChunkExport::totalSize(items));
+		auto progress = [this, total](uint64_t written)
+		{
+			setProgress((double)written / (double)total);
+			return !threadShouldExit();
+		};
+		if(concatenate)
+		{
+			std::fstream ostr(RiffDocument::toStdPath(destination), std::ios::out | std::ios::binary | std::ios::trunc);
+			succeeded = ostr.good() && riffrw::ChunkExport::exportToStream(*inputStream, items, ostr, progress);
+		}
+		else
+		{
+			succeeded = riffrw::ChunkExport::exportToDirectory(*inputStream, items, RiffDocument::toStdPath(destination), progress);
+		}
+	}
+	virtual void threadComplete(bool userPressedCancel) override
+	{
+		if(!userPressedCancel)
+		{
+			if(succeeded)	juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::InfoIcon, "Export", juce::String::formatted("%d chunks exported", (int)items.size()));
+			else			juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "ERROR", "failed to export");
+		}
+		delete this;
+	}
+};
+
+// ================================================================================
+// AviIndexVerifyThread
+
+class AviIndexVerifyThread : public juce::ThreadWithProgressWindow
+{
+protected:
+	const RiffDocument& riffDocument;
+	riffrw::AviIndex::VerifyResult result;
+	bool succeeded = false;
+public:
+	AviIndexVerifyThread(const RiffDocument& doc) : juce::ThreadWithProgressWindow("verifying AVI index...", true, true), riffDocument(doc)
+	{
+	}
+	virtual void run() override
+	{
+		succeeded = riffDocument.verifyAviIndex(result, [this](size_t i, size_t c)
+		{
+			if(!(i & 0xff)) setProgress((double)i / (double)c);
+			return !threadShouldExit();
+		});
+	}
+	virtual void threadComplete(bool userPressedCancel) override
+	{
+		if(!userPressedCancel)
+		{
+			if(!succeeded)
+			{
+				juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "ERROR", "no usable AVI index");
+			}
+			else if(result.mismatches.empty())
+			{
+				juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::InfoIcon, "Verify AVI Index", juce::String::formatted("%d entries checked, no mismatch", (int)result.numChecked));
+			}
+			else
+			{
+				juce::String s = juce::String::formatted("%d entries checked, %d mismatches", (int)result.numChecked, (int)result.mismatches.size());
+				for(size_t i = 0; i < std::min(result.mismatches.size(), (size_t)10); ++i)
+				{
+					const riffrw::AviIndexEntry& e = result.mismatches[i];
+					s += juce::String::formatted("\n%s (%u-%u)", riffrw::FourCC(e.ckid).toString().c_str(), e.hdroffset, e.cksize);
+				}
+				juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Verify AVI Index", s);
+			}
+		}
+		delete this;
+	}
+};
+
+// ================================================================================
+// ChunkStatsThread
+
+class ChunkStatsThread : public juce::ThreadWithProgressWindow
+{
+protected:
+	juce::File contentPath;
+	riffrw::ChunkStats stats;
+	juce::String error;
+	bool succeeded = false;
+public:
+	ChunkStatsThread(const juce::File& path) : juce::ThreadWithProgressWindow("collecting chunk statistics...", true, true), contentPath(path)
+	{
+	}
+	virtual void run() override
+	{
+		setProgress(-1);
+		succeeded = RiffDocument::scanStatistics(contentPath, stats, &error, [this]() { return threadShouldExit(); });
+	}
+	virtual void threadComplete(bool userPressedCancel) override
+	{
+		std::ostringstream ostr;
+		if(userPressedCancel) ostr << "cancelled, the statistics cover the chunks read up to then\n";
+		else if(!succeeded) ostr << "parse failed: " << error << ", the statistics cover the chunks read up to the failure\n";
+		stats.report(ostr);
+		juce::TextEditor* editor = new juce::TextEditor();
+		editor->setMultiLine(true, false);
+		editor->setReadOnly(true);
+		editor->setScrollbarsShown(true);
+		editor->setFont(juce::Font(juce::Font::getDefaultMonospacedFontName(), 14.0f, juce::Font::plain));
+		editor->setText(ostr.str());
+		editor->setSize(800, 480);
+		juce::DialogWindow::LaunchOptions opts;
+		opts.content.setOwned(editor);
+		opts.dialogTitle = "Chunk Statistics - " + contentPath.getFileName();
+		opts.useNativeTitleBar = true;
+		opts.resizable = true;
+		opts.launchAsync();
+		delete this;
+	}
+};
+
 // ================================================================================
 // MainComponent
 
@@ -324,7 +694,11 @@ private:
 	enum CommandIDs
 	{
 		CommandFileOpen = 1,
+		CommandExportChunks,
 		CommandAppExit,
+		CommandGoToFrame,
+		CommandVerifyAviIndex,
+		CommandChunkStats,
 	};
 	juce::ApplicationCommandManager applicationCommandManager;
 	juce::MenuBarComponent menuBarComponent;
@@ -332,6 +706,8 @@ private:
 	RiffNodeTreeView treeView;
 	juce::Viewport viewport;
 	HexViewPane hexViewPane;
+	juce::Viewport fieldsViewport;
+	DecodedFieldsPane decodedFieldsPane;
 	juce::StretchableLayoutManager stretchableLayoutManager;
 	class SplitBar : public juce::StretchableLayoutResizerBar
 	{
@@ -347,12 +723,17 @@ private:
 		}
 	};
 	SplitBar stretchableLayoutResizerBar;
+	SplitBar fieldsResizerBar;
 	RiffDocument riffDocument;
+	juce::String exportQuery;
+	juce::TextEditor filterEditor;
+	std::unordered_set<const riffrw::RiffNode*> filterVisibleNodes; // the matches and their ancestors
+	std::unordered_set<const riffrw::RiffNode*> filterMatchedNodes;
 	bool isPerformingFileDragSource = false;
-	enum { InfoPaneHeight = 20 };
+	enum { InfoPaneHeight = 20, FilterPaneHeight = 24, MaxDecodeSize = 1 << 20 };
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MainComponent)
 public:
-	MainComponent() : stretchableLayoutResizerBar(&stretchableLayoutManager, 1, true)
+	MainComponent() : stretchableLayoutResizerBar(&stretchableLayoutManager, 1, true), fieldsResizerBar(&stretchableLayoutManager, 3, true)
 	{
 		juce::LookAndFeel_V4* lf4 = dynamic_cast<juce::LookAndFeel_V4*>(&juce::LookAndFeel::getDefaultLookAndFeel());
 		addAndMakeVisible(menuBarComponent);
@@ -369,6 +750,12 @@ public:
 		stretchableLayoutManager.setItemLayout(0, 0, -1, 256);
 		stretchableLayoutManager.setItemLayout(1, 8, 8, 8);
 		stretchableLayoutManager.setItemLayout(2, 0, -1, 760);
+		stretchableLayoutManager.setItemLayout(3, 8, 8, 8);
+		stretchableLayoutManager.setItemLayout(4, 0, -1, 320);
+		addAndMakeVisible(filterEditor);
+		filterEditor.setTextToShowWhenEmpty("filter: e.g. LIST.movi/00dc[0:100] or //LIST.INFO", juce::Colours::grey);
+		filterEditor.onReturnKey = [this]() { applyFilter(); };
+		filterEditor.onEscapeKey = [this]() { filterEditor.clear(); applyFilter(); };
 		addAndMakeVisible(treeView);
 		treeView.setDefaultOpenness(true);
 		treeView.setMultiSelectEnabled(false);
@@ -379,70 +766,245 @@ public:
 		hexViewPane.onMouseDrag = [this](const HexViewPane* hvp)
 		{
 			const riffrw::RiffNode* n = hvp->getRiffNode();
-			if(n) performFileDragSource(riffDocument.getContentPath(), n);
+			if(n) performFileDragSource(n);
 		};
 		addAndMakeVisible(stretchableLayoutResizerBar);
-		setSize(1024, 768);
+		addAndMakeVisible(fieldsViewport);
+		fieldsViewport.setViewedComponent(&decodedFieldsPane, false);
+		addAndMakeVisible(fieldsResizerBar);
+		setSize(1344, 768);
 	}
 	virtual ~MainComponent() override
 	{
 		clearContent();
 	}
-	void performFileDragSource(const juce::File& path, const riffrw::RiffNode* n)
+	void performFileDragSource(const riffrw::RiffNode* n)
 	{
 		if(isPerformingFileDragSource) return;
 		isPerformingFileDragSource = true;
-		RiffNodeTempFile::Ptr tmpfile = RiffNodeTempFile::createInstance(path, n);
+		RiffNodeTempFile::Ptr tmpfile = RiffNodeTempFile::createInstance(riffDocument.openContentStream(), n);
 		juce::DragAndDropContainer::performExternalDragDropOfFiles({ tmpfile->getTempPath().getFullPathName() }, false, nullptr, [this, tmpfile]()
 		{
 			isPerformingFileDragSource = false;
 		});
 	}
+	// opens the items down to the node, generating lazy sub items on the way
+	bool selectNode(const riffrw::RiffNode* n)
+	{
+		std::list<const riffrw::RiffNode*> chain;
+		for(const riffrw::RiffNode* pn = n; pn; pn = pn->parent) chain.push_front(pn);
+		RiffNodeTVItem* tvi = dynamic_cast<RiffNodeTVItem*>(treeView.getRootItem());
+		if(!tvi || (chain.front() != tvi->getRiffNode())) return false;
+		chain.pop_front();
+		for(const riffrw::RiffNode* pn : chain)
+		{
+			tvi->setOpen(true);
+			RiffNodeTVItem* tvisub = nullptr;
+			for(int i = 0; !tvisub && (i < tvi->getNumSubItems()); ++i)
+			{
+				RiffNodeTVItem* p = dynamic_cast<RiffNodeTVItem*>(tvi->getSubItem(i));
+				if(p && (p->getRiffNode() == pn)) tvisub = p;
+			}
+			if(!tvisub) return false;
+			tvi = tvisub;
+		}
+		tvi->setSelected(true, true);
+		treeView.scrollToKeepItemVisible(tvi);
+		return true;
+	}
+	void goToFrame()
+	{
+		if(!riffDocument.isAvi()) return;
+		juce::AlertWindow* aw = new juce::AlertWindow("Go to Frame", "stream and frame number, counted from 0", juce::MessageBoxIconType::NoIcon, this);
+		aw->addTextEditor("stream", "0", "stream:");
+		aw->addTextEditor("frame", "0", "frame:");
+		aw->addButton("OK", 1, juce::KeyPress(juce::KeyPress::returnKey));
+		aw->addButton("Cancel", 0, juce::KeyPress(juce::KeyPress::escapeKey));
+		aw->enterModalState(true, juce::ModalCallbackFunction::create([this, aw](int result)
+		{
+			if(!result) return;
+			int stream = aw->getTextEditorContents("stream").getIntValue();
+			juce::int64 frame = aw->getTextEditorContents("frame").getLargeIntValue();
+			const riffrw::RiffNode* movi = riffrw::AviIndex::findMovi(riffDocument.getRootNode());
+			if(!movi) return;
+			if(riffDocument.isLazyNode(movi)) riffDocument.expandLazyNode(movi);
+			const riffrw::RiffNode* n = (0 <= frame) ? riffrw::AviIndex::findFrame(*movi, stream, (size_t)frame) : nullptr;
+			if(n && selectNode(n)) return;
+			juce::String message = "no such frame";
+			if(n) message = "the frame is not shown in the tree";
+			else if((0 <= frame) && riffDocument.hasTrailingSegments())
+			{
+				message = "stream " + juce::String(stream) + " has " + juce::String((juce::int64)riffrw::AviIndex::countFrames(*movi, stream)) + " frames in the first RIFF segment. "
+					"Frames in the RIFF AVIX segments that follow, and index entries beyond 4 GiB, cannot be reached.";
+			}
+			juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Go to Frame", message);
+		}), true);
+	}
+	void exportChunks()
+	{
+		if(riffDocument.getContentPath() == juce::File()) return;
+		juce::AlertWindow* aw = new juce::AlertWindow("Export Chunks", "chunk path query, e.g. LIST.movi/00dc or smpl", juce::MessageBoxIconType::NoIcon, this);
+		aw->addTextEditor("query", exportQuery, "query:");
+		aw->addComboBox("output", { "one file per chunk", "single concatenated file" }, "output:");
+		aw->getComboBoxComponent("output")->setSelectedItemIndex(0);
+		aw->addButton("OK", 1, juce::KeyPress(juce::KeyPress::returnKey));
+		aw->addButton("Cancel", 0, juce::KeyPress(juce::KeyPress::escapeKey));
+		aw->enterModalState(true, juce::ModalCallbackFunction::create([this, aw](int result)
+		{
+			if(!result) return;
+			exportQuery = aw->getTextEditorContents("query").trimStart();
+			riffrw::Query query(exportQuery.toStdString());
+			if(!query.isValid())
+			{
+				juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Export", "invalid query: " + juce::String(query.getError()));
+				return;
+			}
+			riffDocument.expandLazyNodes(query.descendFilter());
+			refreshLazyItems();
+			bool concatenate = aw->getComboBoxComponent("output")->getSelectedItemIndex() == 1;
+			std::vector<riffrw::ChunkExport::Item> items = riffrw::ChunkExport::selectItems(riffDocument.getRootNode(), query);
+			if(items.empty())
+			{
+				juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Export", "no matching chunks");
+				return;
+			}
+			std::shared_ptr<juce::FileChooser> fcdlg = std::make_unique<juce::FileChooser>(concatenate ? "Export to file" : "Export to directory");
+			int flags = concatenate ? (juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles | juce::FileBrowserComponent::warnAboutOverwriting) : (juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectDirectories);
+			fcdlg->launchAsync(flags, [this, fcdlg, items, concatenate](const juce::FileChooser& fc) mutable
+			{
+				juce::File path = fc.getResult();
+				fcdlg.reset();
+				if(path == juce::File()) return;
+				std::unique_ptr<std::istream> istr = riffDocument.openContentStream();
+				if(!istr) return;
+				(new ChunkExportThread(std::move(istr), items, path, concatenate))->launchThread();
+			});
+		}), true);
+	}
+	// generates the sub items of lazy nodes which were expanded behind the tree view
+	void refreshLazyItems()
+	{
+		std::function<void(juce::TreeViewItem*)> walk = [&walk](juce::TreeViewItem* tvi)
+		{
+			RiffNodeTVItem* rtvi = dynamic_cast<RiffNodeTVItem*>(tvi);
+			if(rtvi && rtvi->onOpened && !rtvi->getNumSubItems() && !rtvi->getRiffNode()->subnodes.empty()) rtvi->onOpened(rtvi);
+			for(int i = 0; i < tvi->getNumSubItems(); ++i) walk(tvi->getSubItem(i));
+		};
+		if(juce::TreeViewItem* tvi = treeView.getRootItem()) walk(tvi);
+	}
 	void clearContent()
 	{
-		hexViewPane.clearRiffNode();
+		hexViewPane.setContentStream(nullptr);
+		decodedFieldsPane.clearFields();
 		treeView.deleteRootItem();
+		filterVisibleNodes.clear();
+		filterMatchedNodes.clear();
 		riffDocument.clearContent();
 		infoLabel.setText("", juce::dontSendNotification);
 	}
+	bool hasContent() const
+	{
+		return riffDocument.getContentPath() != juce::File();
+	}
 	bool loadContent(const juce::File& path)
 	{
 		clearContent();
 		if(!riffDocument.loadContent(path))
 		{
-			juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "ERROR", "failed to load");
+			juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "ERROR", "failed to load\n" + riffDocument.getLastError());
 			return false;
 		}
-		const riffrw::RiffNode& nroot = riffDocument.getRootNode();
-		juce::TreeViewItem* tvi = generateTree(&nroot);
-		treeView.setRootItem(tvi);
-		infoLabel.setText(path.getFullPathName(), juce::dontSendNotification);
+		hexViewPane.setContentStream(riffDocument.openContentStream(), riffDocument.openContentStream());
+		applyFilter();
 		return true;
 	}
-	juce::TreeViewItem* generateTree(const riffrw::RiffNode* n)
+	// rebuilds the tree with the nodes matching the filter query, or all nodes if the filter is empty
+	void applyFilter()
+	{
+		filterVisibleNodes.clear();
+		filterMatchedNodes.clear();
+		hexViewPane.clearRiffNode();
+		decodedFieldsPane.clearFields();
+		treeView.deleteRootItem();
+		if(riffDocument.getContentPath() == juce::File()) return;
+		bool filtered = false;
+		juce::String text = filterEditor.getText().trimStart();
+		if(text.isNotEmpty())
+		{
+			riffrw::Query query(text.toStdString());
+			if(query.isValid())
+			{
+				riffDocument.expandLazyNodes(query.descendFilter());
+				query.select(riffDocument.getRootNode(), [this](const riffrw::RiffNode& n)
+				{
+					filterMatchedNodes.insert(&n);
+					for(const riffrw::RiffNode* pn = &n; pn && filterVisibleNodes.insert(pn).second; pn = pn->parent);
+				});
+				filtered = true;
+				infoLabel.setText(riffDocument.getContentPath().getFullPathName() + juce::String::formatted("  [%d matches]", (int)filterMatchedNodes.size()), juce::dontSendNotification);
+			}
+			else
+			{
+				infoLabel.setText(riffDocument.getContentPath().getFullPathName() + "  [invalid query: " + juce::String(query.getError()) + "]", juce::dontSendNotification);
+			}
+		}
+		else
+		{
+			infoLabel.setText(riffDocument.getContentPath().getFullPathName(), juce::dontSendNotification);
+		}
+		if(filtered && filterVisibleNodes.empty()) return;
+		treeView.setRootItem(generateTree(&riffDocument.getRootNode(), filtered));
+	}
+	// filtered: generate only the sub items on the way to the filter matches
+	juce::TreeViewItem* generateTree(const riffrw::RiffNode* n, bool filtered = false)
 	{
 		RiffNodeTVItem* tvi = new RiffNodeTVItem(n);
-		if(n->ckinfo.header.isContainer())
+		if(filtered && filterMatchedNodes.count(n)) filtered = false;
+		if(riffDocument.isLazyNode(n))
+		{
+			// the sub items are generated when the item is opened
+			tvi->setOpenness(juce::TreeViewItem::Openness::opennessClosed);
+			tvi->onOpened = [this, filtered](RiffNodeTVItem* tvi)
+			{
+				if(tvi->getNumSubItems()) return;
+				riffDocument.expandLazyNode(tvi->getRiffNode());
+				for(const auto& ns : tvi->getRiffNode()->subnodes)
+				{
+					if(!filtered || filterVisibleNodes.count(&ns)) tvi->addSubItem(generateTree(&ns, filtered));
+				}
+			};
+		}
+		else if(n->ckinfo.header.isContainer())
 		{
+			tvi->onSelectionChanged = [this](const RiffNodeTVItem* tvi) { updateDecodedFields(tvi); };
 			for(const auto& ns : n->subnodes)
 			{
-				tvi->addSubItem(generateTree(&ns));
+				if(!filtered || filterVisibleNodes.count(&ns)) tvi->addSubItem(generateTree(&ns, filtered));
 			}
 		}
 		else
 		{
 			tvi->onSelectionChanged = [this](const RiffNodeTVItem* tvi)
 			{
-				if(tvi->isSelected()) { if(hexViewPane.getRiffNode() != tvi->getRiffNode()) hexViewPane.setRiffNode(riffDocument.getContentPath(), tvi->getRiffNode()); }
+				if(tvi->isSelected()) { if(hexViewPane.getRiffNode() != tvi->getRiffNode()) hexViewPane.setRiffNode(tvi->getRiffNode()); }
 				else				  { if(hexViewPane.getRiffNode() == tvi->getRiffNode()) hexViewPane.clearRiffNode(); }
+				updateDecodedFields(tvi);
 			};
 			tvi->onMouseDrag = [this](const RiffNodeTVItem* tvi)
 			{
-				performFileDragSource(riffDocument.getContentPath(), tvi->getRiffNode());
+				performFileDragSource(tvi->getRiffNode());
 			};
 		}
 		return tvi;
 	}
+	void updateDecodedFields(const RiffNodeTVItem* tvi)
+	{
+		if(!tvi->isSelected()) { decodedFieldsPane.clearFields(); return; }
+		const riffrw::RiffNode* n = tvi->getRiffNode();
+		std::vector<uint8_t> buf;
+		if(riffrw::ChunkViews::accepts(n->ckinfo, n->parent ? &n->parent->ckinfo : nullptr)) riffDocument.readChunkPayload(n, buf, MaxDecodeSize);
+		decodedFieldsPane.setFields(*n, buf.data(), buf.size());
+	}
 	// --------------------------------------------------------------------------------
 	// juce::Component
 	virtual void resized() override
@@ -450,9 +1012,13 @@ public:
 		juce::Rectangle<int> rc = getLocalBounds();
 		menuBarComponent.setBounds(rc.removeFromTop(getLookAndFeel().getDefaultMenuBarHeight()));
 		infoLabel.setBounds(rc.removeFromTop(InfoPaneHeight));
-		juce::Component* vcmp[] = { &treeView, &stretchableLayoutResizerBar, &viewport };
-		stretchableLayoutManager.layOutComponents(vcmp, 3, rc.getX(), rc.getY(), rc.getWidth(), rc.getHeight(), false, true);
+		juce::Component* vcmp[] = { &treeView, &stretchableLayoutResizerBar, &viewport, &fieldsResizerBar, &fieldsViewport };
+		stretchableLayoutManager.layOutComponents(vcmp, 5, rc.getX(), rc.getY(), rc.getWidth(), rc.getHeight(), false, true);
+		juce::Rectangle<int> rctree = treeView.getBounds();
+		filterEditor.setBounds(rctree.removeFromTop(FilterPaneHeight));
+		treeView.setBounds(rctree);
 		hexViewPane.updatePaneSize();
+		decodedFieldsPane.updatePaneSize();
 	}
 	virtual void paint(juce::Graphics& g) override
 	{
@@ -476,7 +1042,7 @@ public:
 	// juce::MenuBarModel
 	virtual juce::StringArray getMenuBarNames() override
 	{
-		return { "File" };
+		return { "File", "AVI" };
 	}
 	virtual juce::PopupMenu getMenuForIndex(int imenu, const juce::String&) override
 	{
@@ -484,9 +1050,16 @@ public:
 		if(imenu == 0)
 		{
 			menu.addCommandItem(&applicationCommandManager, CommandIDs::CommandFileOpen);
+			menu.addCommandItem(&applicationCommandManager, CommandIDs::CommandExportChunks);
+			menu.addCommandItem(&applicationCommandManager, CommandIDs::CommandChunkStats);
 			menu.addSeparator();
 			menu.addCommandItem(&applicationCommandManager, CommandIDs::CommandAppExit);
 		}
+		else if(imenu == 1)
+		{
+			menu.addCommandItem(&applicationCommandManager, CommandIDs::CommandGoToFrame);
+			menu.addCommandItem(&applicationCommandManager, CommandIDs::CommandVerifyAviIndex);
+		}
 		return menu;
 	}
 	virtual void menuItemSelected(int, int) override {}
@@ -501,7 +1074,11 @@ public:
 		juce::Array<juce::CommandID> commands
 		{
 			CommandIDs::CommandFileOpen,
+			CommandIDs::CommandExportChunks,
 			CommandIDs::CommandAppExit,
+			CommandIDs::CommandGoToFrame,
+			CommandIDs::CommandVerifyAviIndex,
+			CommandIDs::CommandChunkStats,
 		};
 		c.addArray(commands);
 	}
@@ -513,10 +1090,28 @@ public:
 				info.setInfo("Open...", "open RIFF files", "File", 0);
 				info.addDefaultKeypress('o', juce::ModifierKeys::commandModifier);
 				break;
+			case CommandIDs::CommandExportChunks:
+				info.setInfo("Export Chunks...", "export the payloads of the chunks matching a path pattern", "File", 0);
+				info.addDefaultKeypress('e', juce::ModifierKeys::commandModifier);
+				info.setActive(riffDocument.getContentPath() != juce::File());
+				break;
 			case CommandIDs::CommandAppExit:
 				info.setInfo("Exit", "exit", "Application", 0);
 				info.addDefaultKeypress(juce::KeyPress::F4Key, juce::ModifierKeys::altModifier);
 				return;
+			case CommandIDs::CommandGoToFrame:
+				info.setInfo("Go to Frame...", "select the chunk of a frame in the movi list", "AVI", 0);
+				info.addDefaultKeypress('g', juce::ModifierKeys::commandModifier);
+				info.setActive(riffDocument.isAvi());
+				break;
+			case CommandIDs::CommandVerifyAviIndex:
+				info.setInfo("Verify Index", "cross-check the idx1/indx entries against the chunk headers", "AVI", 0);
+				info.setActive(riffDocument.isAvi());
+				break;
+			case CommandIDs::CommandChunkStats:
+				info.setInfo("Chunk Statistics", "summarize the chunk sizes, padding, nesting depth and anomalies", "File", 0);
+				info.setActive(hasContent());
+				break;
 		}
 	}
 	virtual bool perform(const InvocationInfo& info) override
@@ -534,9 +1129,21 @@ public:
 				});
 				return true;
 			}
+			case CommandIDs::CommandExportChunks:
+				exportChunks();
+				return true;
 			case CommandIDs::CommandAppExit:
 				juce::JUCEApplication::getInstance()->systemRequestedQuit();
 				return true;
+			case CommandIDs::CommandGoToFrame:
+				goToFrame();
+				return true;
+			case CommandIDs::CommandVerifyAviIndex:
+				if(riffDocument.isAvi()) (new AviIndexVerifyThread(riffDocument))->launchThread();
+				return true;
+			case CommandIDs::CommandChunkStats:
+				if(hasContent()) (new ChunkStatsThread(riffDocument.getContentPath()))->launchThread();
+				return true;
 		}
 		return false;
 	}
@@ -545,4 +1152,16 @@ public:
 juce::Component* MainComponentCreateInstance()
 {
 	return new MainComponent;
+}
+
+bool MainComponentLoadContent(juce::Component* c, const juce::File& path)
+{
+	MainComponent* mc = dynamic_cast<MainComponent*>(c);
+	return mc && mc->loadContent(path);
+}
+
+bool MainComponentHasContent(const juce::Component* c)
+{
+	const MainComponent* mc = dynamic_cast<const MainComponent*>(c);
+	return mc && mc->hasContent();
 }
\ No newline at end of file
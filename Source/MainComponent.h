@@ -10,3 +10,5 @@
 #include <JuceHeader.h>
 
 juce::Component* MainComponentCreateInstance();
+bool MainComponentLoadContent(juce::Component* c, const juce::File& path);
+bool MainComponentHasContent(const juce::Component* c);
@@ -0,0 +1,308 @@
+//
+//  RiffDocument.h
+//  RiffView_App
+//
+//  created by yu2924 on 2026-10-18
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "riffrw.h"
+#include "riffindex.h"
+#include "riffavi.h"
+#include "riffcompressed.h"
+#include "riffstats.h"
+
+#ifndef RIFFVIEW_USE_ZSTD
+#define RIFFVIEW_USE_ZSTD 0
+#endif
+#if RIFFVIEW_USE_ZSTD
+#include <zstd.h>
+#if JUCE_MSVC
+#pragma comment(lib, "libzstd_static.lib")
+#endif
+#endif
+
+class RiffDocument
+{
+protected:
+	// process wide cache of the recently loaded trees, so that a file opened again, e.g. handed over from another launch, skips the parse
+	struct TreeCache
+	{
+		struct Entry
+		{
+			juce::File path;
+			riffrw::IndexKey key;
+			riffrw::RiffNode rootNode;
+			std::shared_ptr<const riffrw::CompressedIndex> compressedIndex;
+		};
+		enum { MaxEntries = 8 };
+		std::mutex mutex;
+		std::list<Entry> entries; // most recently used first
+		bool lookup(const juce::File& path, const riffrw::IndexKey& key, riffrw::RiffNode* pn, std::shared_ptr<const riffrw::CompressedIndex>* pcindex)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for(auto it = entries.begin(); it != entries.end(); ++it)
+			{
+				if((it->path != path) || (it->key != key)) continue;
+				entries.splice(entries.begin(), entries, it);
+				*pn = entries.front().rootNode;
+				*pcindex = entries.front().compressedIndex;
+				return true;
+			}
+			return false;
+		}
+		void store(const juce::File& path, const riffrw::IndexKey& key, const riffrw::RiffNode& n, const std::shared_ptr<const riffrw::CompressedIndex>& cindex)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			entries.remove_if([&path](const Entry& e) { return e.path == path; });
+			entries.push_front({ path, key, n, cindex });
+			while((size_t)MaxEntries < entries.size()) entries.pop_back();
+		}
+	};
+	static TreeCache& getTreeCache()
+	{
+		static TreeCache cache;
+		return cache;
+	}
+	juce::File contentPath;
+	riffrw::RiffNode rootNode{};
+	std::shared_ptr<const riffrw::CompressedIndex> compressedIndex;
+	juce::String lastError;
+public:
+	RiffDocument()
+	{
+	}
+	void clearContent()
+	{
+		contentPath = {};
+		rootNode = {};
+		compressedIndex = nullptr;
+	}
+	static juce::File getIndexCacheDirectory()
+	{
+#if JUCE_WINDOWS
+		return juce::File::getSpecialLocation(juce::File::windowsLocalAppData).getChildFile("RiffView").getChildFile("IndexCache");
+#elif JUCE_MAC
+		return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory).getChildFile("Caches").getChildFile("RiffView");
+#else
+		juce::String xdg = juce::SystemStats::getEnvironmentVariable("XDG_CACHE_HOME", {});
+		juce::File dir = xdg.isNotEmpty() ? juce::File(xdg) : juce::File::getSpecialLocation(juce::File::userHomeDirectory).getChildFile(".cache");
+		return dir.getChildFile("RiffView");
+#endif
+	}
+	static juce::File getIndexCacheFile(const juce::File& path)
+	{
+		return getIndexCacheDirectory().getChildFile(juce::String::toHexString(path.getFullPathName().hashCode64()) + ".rvidx");
+	}
+	static std::filesystem::path toStdPath(const juce::File& path)
+	{
+		return std::filesystem::path(std::wstring(path.getFullPathName().toUTF16()));
+	}
+	static bool makeIndexKey(const juce::File& path, riffrw::IndexKey* pkey)
+	{
+		std::fstream istr(toStdPath(path), std::ios::in | std::ios::binary);
+		if(!istr.good()) return false;
+		pkey->pathhash = riffrw::RiffIndex::computeChecksum(std::string(path.getFullPathName().toRawUTF8()));
+		pkey->filesize = (uint64_t)path.getSize();
+		pkey->mtime = path.getLastModificationTime().toMilliseconds();
+		pkey->checksum = riffrw::RiffIndex::computeChecksum(istr);
+		return true;
+	}
+	static bool decodeGzipBlock(const void* src, size_t srclen, void* dst, size_t dstlen)
+	{
+		juce::MemoryInputStream mis(src, srclen, false);
+		juce::GZIPDecompressorInputStream gzis(&mis, false, juce::GZIPDecompressorInputStream::gzipFormat);
+		char* p = (char*)dst;
+		for(size_t c = 0; c < dstlen;)
+		{
+			int lr = gzis.read(p + c, (int)(dstlen - c));
+			if(lr <= 0) return false;
+			c += (size_t)lr;
+		}
+		return true;
+	}
+#if RIFFVIEW_USE_ZSTD
+	static bool decodeZstdBlock(const void* src, size_t srclen, void* dst, size_t dstlen)
+	{
+		return ZSTD_decompress(dst, dstlen, src, srclen) == dstlen;
+	}
+#endif
+	// the uncompressed content, decompressed block by block if the file is BGZF or seekable zstd
+	static std::unique_ptr<std::istream> openStream(const juce::File& path, const std::shared_ptr<const riffrw::CompressedIndex>& index)
+	{
+		std::unique_ptr<std::fstream> str = std::make_unique<std::fstream>(toStdPath(path), std::ios::in | std::ios::binary);
+		if(!str->good()) return nullptr;
+		if(!index) return str;
+		riffrw::BlockDecoder decoder;
+		if(index->format == riffrw::CompressedIndex::Bgzf) decoder = decodeGzipBlock;
+#if RIFFVIEW_USE_ZSTD
+		if(index->format == riffrw::CompressedIndex::SeekableZstd) decoder = decodeZstdBlock;
+#endif
+		if(!decoder) return nullptr;
+		return std::make_unique<riffrw::CompressedInputStream>(std::move(str), index, decoder);
+	}
+	static bool buildCompressedIndex(const juce::File& path, std::shared_ptr<const riffrw::CompressedIndex>* pindex, juce::String* perror)
+	{
+		*pindex = nullptr;
+		std::fstream istr(toStdPath(path), std::ios::in | std::ios::binary);
+		if(!istr.good()) { *perror = "cannot open the file"; return false; }
+		std::shared_ptr<riffrw::CompressedIndex> index = std::make_shared<riffrw::CompressedIndex>();
+		if(!riffrw::CompressedIndex::build(istr, *index, toStdPath(juce::File(path.getFullPathName() + ".gzi")))) { *perror = "broken compressed block structure"; return false; }
+		if(!isSupportedFormat(index->format, perror)) return false;
+		if(index->format != riffrw::CompressedIndex::Uncompressed) *pindex = index;
+		return true;
+	}
+	static bool isSupportedFormat(riffrw::CompressedIndex::Format format, juce::String* perror)
+	{
+		switch(format)
+		{
+			case riffrw::CompressedIndex::Gzip: *perror = "gzip file is not seekable, recompress it with bgzip"; return false;
+			case riffrw::CompressedIndex::Zstd: *perror = "zstd file is not seekable, recompress it with a seek table"; return false;
+#if !RIFFVIEW_USE_ZSTD
+			case riffrw::CompressedIndex::SeekableZstd: *perror = "zstd support is not enabled in this build"; return false;
+#endif
+			default: return true;
+		}
+	}
+	// descendFilter: parse only the containers it accepts, for one-shot queries; such a partial tree is not cached
+	bool loadContent(const juce::File& path, const riffrw::RiffNode::DescendFilter& descendFilter = nullptr)
+	{
+		clearContent();
+		lastError = {};
+		riffrw::IndexKey key = {};
+		if(!makeIndexKey(path, &key)) { lastError = "cannot open the file"; return false; }
+		riffrw::RiffNode n = {};
+		std::shared_ptr<const riffrw::CompressedIndex> cindex;
+		if(getTreeCache().lookup(path, key, &n, &cindex))
+		{
+			rootNode = std::move(n);
+			contentPath = path;
+			compressedIndex = cindex;
+			return true;
+		}
+		juce::File idxpath = getIndexCacheFile(path);
+		bool fromindex = false;
+		if(idxpath.existsAsFile())
+		{
+			// the image carries the block table too, a valid index skips walking the compressed blocks
+			juce::MemoryMappedFile mmf(idxpath, juce::MemoryMappedFile::readOnly);
+			std::shared_ptr<riffrw::CompressedIndex> index = std::make_shared<riffrw::CompressedIndex>();
+			fromindex = riffrw::RiffIndex::readTreeFromIndexImage(mmf.getData(), mmf.getSize(), key, &n, index.get());
+			if(fromindex && !isSupportedFormat(index->format, &lastError)) return false;
+			if(fromindex && (index->format != riffrw::CompressedIndex::Uncompressed)) cindex = index;
+		}
+		if(!fromindex)
+		{
+			if(!buildCompressedIndex(path, &cindex, &lastError)) return false;
+			n = {};
+			// AVI: the movi list is left unparsed and populated from idx1/indx on demand, see expandLazyNode()
+			auto filter = [&descendFilter](const riffrw::RiffNode& ns) { return !isLazyCandidate(ns) && (!descendFilter || descendFilter(ns)); };
+			auto factory = [&path, &cindex]() { return openStream(path, cindex); };
+			if(!riffrw::RiffNode::readTreeParallel(factory, &n, 0, filter)) { lastError = "not a valid RIFF file"; return false; }
+			if(!descendFilter) riffrw::RiffIndex::writeIndexToFile(n, key, toStdPath(idxpath), cindex.get());
+		}
+		if(fromindex || !descendFilter) getTreeCache().store(path, key, n, cindex);
+		rootNode = std::move(n);
+		contentPath = path;
+		compressedIndex = cindex;
+		return true;
+	}
+	// a full parse of the file (including the AVI movi list) with the statistics accumulated on the way, merged into stats
+	static bool scanStatistics(const juce::File& path, riffrw::ChunkStats& stats, juce::String* perror = nullptr, const std::function<bool()>& shouldExit = nullptr)
+	{
+		juce::String error;
+		std::shared_ptr<const riffrw::CompressedIndex> cindex;
+		if(!buildCompressedIndex(path, &cindex, &error))
+		{
+			if(perror) *perror = error;
+			++stats.numFiles;
+			++stats.numFailed;
+			return false;
+		}
+		uint64_t streamsize = cindex ? cindex->totalSize() : (uint64_t)path.getSize();
+		riffrw::RiffNode n = {};
+		bool ok = stats.readTree([&path, &cindex]() { return openStream(path, cindex); }, streamsize, &n, 0, shouldExit);
+		if(!ok && perror) *perror = (shouldExit && shouldExit()) ? "cancelled" : "not a valid RIFF file";
+		return ok;
+	}
+	const juce::String& getLastError() const
+	{
+		return lastError;
+	}
+	const juce::File& getContentPath() const
+	{
+		return contentPath;
+	}
+	const riffrw::RiffNode& getRootNode() const
+	{
+		return rootNode;
+	}
+	static bool isLazyCandidate(const riffrw::RiffNode& n)
+	{
+		return riffrw::AviIndex::isMovi(n) && n.parent && !n.parent->parent && riffrw::AviIndex::isAvi(*n.parent);
+	}
+	bool isAvi() const
+	{
+		return riffrw::AviIndex::isAvi(rootNode);
+	}
+	// the tree holds the first RIFF chunk only; anything after it (e.g. OpenDML RIFF AVIX segments) is not reachable
+	bool hasTrailingSegments() const
+	{
+		if(contentPath == juce::File()) return false;
+		uint64_t size = compressedIndex ? compressedIndex->totalSize() : (uint64_t)contentPath.getSize();
+		uint64_t end = (uint64_t)rootNode.ckinfo.hdroffset + 8 + rootNode.ckinfo.header.cksize;
+		return (end + 8) <= size;
+	}
+	// a container whose subnodes have not been read yet
+	bool isLazyNode(const riffrw::RiffNode* n) const
+	{
+		return isLazyCandidate(*n) && n->subnodes.empty() && (4 < n->ckinfo.header.cksize);
+	}
+	// fills the subnodes from the AVI index, or parses the list if the index is missing or unusable
+	bool expandLazyNode(const riffrw::RiffNode* n)
+	{
+		if(!isLazyNode(n)) return false;
+		std::unique_ptr<std::istream> istr = openContentStream();
+		if(!istr) return false;
+		if(riffrw::AviIndex::populateMovi(*istr, rootNode)) return true;
+		riffrw::RiffNode* pn = const_cast<riffrw::RiffNode*>(n);
+		pn->subnodes.clear();
+		istr->clear();
+		istr->seekg(pn->ckinfo.hdroffset);
+		riffrw::RiffReader reader(*istr);
+		return riffrw::RiffNode::readTree(reader, pn);
+	}
+	void expandLazyNodes(const riffrw::RiffNode::DescendFilter& descendFilter = nullptr)
+	{
+		for(const auto& ns : rootNode.subnodes)
+		{
+			if(isLazyNode(&ns) && (!descendFilter || descendFilter(ns))) expandLazyNode(&ns);
+		}
+	}
+	bool verifyAviIndex(riffrw::AviIndex::VerifyResult& result, std::function<bool(size_t, size_t)> progress = nullptr) const
+	{
+		std::unique_ptr<std::istream> istr = openContentStream();
+		if(!istr) return false;
+		return riffrw::AviIndex::verifyIndex(*istr, rootNode, result, progress);
+	}
+	// the leading part of the payload, up to maxsize bytes
+	bool readChunkPayload(const riffrw::RiffNode* n, std::vector<uint8_t>& buf, size_t maxsize) const
+	{
+		buf.clear();
+		std::unique_ptr<std::istream> istr = openContentStream();
+		if(!istr) return false;
+		buf.resize(std::min((size_t)n->ckinfo.header.cksize, maxsize));
+		istr->seekg((std::streamoff)n->ckinfo.hdroffset + 8);
+		istr->read((char*)buf.data(), buf.size());
+		buf.resize((size_t)istr->gcount());
+		return true;
+	}
+	// an independent stream on the uncompressed content, for readers that run apart from the view
+	std::unique_ptr<std::istream> openContentStream() const
+	{
+		if(contentPath == juce::File()) return nullptr;
+		return openStream(contentPath, compressedIndex);
+	}
+};
@@ -0,0 +1,257 @@
+//
+//  riffavi.h
+//  AVI index (idx1, OpenDML indx/ix##) driven navigation
+//
+//  created by yu2924 on 2026-10-18
+//
+
+#pragma once
+
+#include "riffrw.h"
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+
+namespace riffrw
+{
+
+	struct AviIndexEntry
+	{
+		uint32_t ckid;
+		uint32_t flags;
+		uint32_t hdroffset;
+		uint32_t cksize;
+	};
+
+	struct AviIndex
+	{
+		enum
+		{
+			AVIIF_LIST = 0x00000001,
+			AVI_INDEX_OF_INDEXES = 0x00,
+			AVI_INDEX_OF_CHUNKS = 0x01,
+			MaxIndexChunkSize = 64 << 20,
+		};
+		template<typename T> static T readLE(const uint8_t* p)
+		{
+			T v;
+			std::memcpy(&v, p, sizeof(v));
+			return v;
+		}
+		static bool isAvi(const RiffNode& root)
+		{
+			return (root.ckinfo.header.ckid == FourCC("RIFF")) && (root.ckinfo.type == FourCC("AVI "));
+		}
+		static bool isMovi(const RiffNode& n)
+		{
+			return (n.ckinfo.header.ckid == FourCC("LIST")) && (n.ckinfo.type == FourCC("movi"));
+		}
+		static const RiffNode* findSubNode(const RiffNode& n, uint32_t ckid, uint32_t type = 0)
+		{
+			for(const auto& ns : n.subnodes)
+			{
+				if((ns.ckinfo.header.ckid == ckid) && (!type || (ns.ckinfo.type == type))) return &ns;
+			}
+			return nullptr;
+		}
+		static const RiffNode* findMovi(const RiffNode& root)
+		{
+			return findSubNode(root, FourCC("LIST"), FourCC("movi"));
+		}
+		// "00dc" -> 0, "01wb" -> 1, anything else (e.g. "ix00", "JUNK") -> -1
+		static int streamNumber(uint32_t ckid)
+		{
+			const char* p = (const char*)&ckid;
+			if(!isdigit((uint8_t)p[0]) || !isdigit((uint8_t)p[1])) return -1;
+			return (p[0] - '0') * 10 + (p[1] - '0');
+		}
+		static bool readChunkPayload(std::istream& istr, uint64_t hdroffset, uint32_t ckid, std::vector<uint8_t>& buf)
+		{
+			ChunkHeader hdr = {};
+			istr.clear();
+			istr.seekg((std::streamoff)hdroffset);
+			if(!istr.read((char*)&hdr, 8).good()) return false;
+			if((hdr.ckid != ckid) || (MaxIndexChunkSize < hdr.cksize)) return false;
+			buf.resize(hdr.cksize);
+			return istr.read((char*)buf.data(), buf.size()).good();
+		}
+		// idx1: offsets are relative to the 'movi' list type field, some writers store absolute offsets
+		static bool readIdx1(std::istream& istr, const RiffNode& root, std::vector<AviIndexEntry>& entries)
+		{
+			const RiffNode* movi = findMovi(root);
+			const RiffNode* idx1 = findSubNode(root, FourCC("idx1"));
+			if(!movi || !idx1) return false;
+			std::vector<uint8_t> buf;
+			if(!readChunkPayload(istr, idx1->ckinfo.hdroffset, idx1->ckinfo.header.ckid, buf)) return false;
+			size_t num = buf.size() / 16;
+			if(!num) return false;
+			uint32_t base = (readLE<uint32_t>(buf.data() + 8) < movi->ckinfo.hdroffset + 12) ? (movi->ckinfo.hdroffset + 8) : 0;
+			for(size_t i = 0; i < num; ++i)
+			{
+				const uint8_t* p = buf.data() + i * 16;
+				entries.push_back({ readLE<uint32_t>(p), readLE<uint32_t>(p + 4), base + readLE<uint32_t>(p + 8), readLE<uint32_t>(p + 12) });
+			}
+			return true;
+		}
+		// standard index (AVI_INDEX_OF_CHUNKS): qwBaseOffset + dwOffset points at the chunk data
+		static void parseStandardIndex(const uint8_t* p, size_t c, std::vector<AviIndexEntry>& entries)
+		{
+			if(c < 24) return;
+			uint32_t stride = readLE<uint16_t>(p) * 4;
+			uint32_t num = readLE<uint32_t>(p + 4);
+			uint32_t ckid = readLE<uint32_t>(p + 8);
+			uint64_t base = readLE<uint64_t>(p + 12);
+			if(stride < 8) return;
+			for(uint32_t i = 0; (i < num) && (24 + (size_t)(i + 1) * stride <= c); ++i)
+			{
+				const uint8_t* pe = p + 24 + (size_t)i * stride;
+				uint64_t hdroffset = base + readLE<uint32_t>(pe) - 8;
+				if(0xffffffffull < hdroffset) continue; // beyond the first RIFF segment
+				entries.push_back({ ckid, 0, (uint32_t)hdroffset, readLE<uint32_t>(pe + 4) & 0x7fffffff });
+			}
+		}
+		// OpenDML: LIST.hdrl/LIST.strl/indx is a super index pointing at ix## chunks, or directly a standard index
+		// covered[n] tells whether the n-th strl had a usable indx
+		static bool readOpenDmlIndex(std::istream& istr, const RiffNode& root, std::vector<AviIndexEntry>& entries, std::vector<bool>& covered)
+		{
+			covered.clear();
+			const RiffNode* hdrl = findSubNode(root, FourCC("LIST"), FourCC("hdrl"));
+			if(!hdrl) return false;
+			bool found = false;
+			std::vector<uint8_t> buf, ixbuf;
+			for(const auto& strl : hdrl->subnodes)
+			{
+				if((strl.ckinfo.header.ckid != FourCC("LIST")) || (strl.ckinfo.type != FourCC("strl"))) continue;
+				covered.push_back(false);
+				const RiffNode* indx = findSubNode(strl, FourCC("indx"));
+				if(!indx || !readChunkPayload(istr, indx->ckinfo.hdroffset, indx->ckinfo.header.ckid, buf) || (buf.size() < 24)) continue;
+				uint8_t indextype = buf[3];
+				if(indextype == AVI_INDEX_OF_CHUNKS)
+				{
+					parseStandardIndex(buf.data(), buf.size(), entries);
+					found = true;
+					covered.back() = true;
+					continue;
+				}
+				if(indextype != AVI_INDEX_OF_INDEXES) continue;
+				uint32_t stride = readLE<uint16_t>(buf.data()) * 4;
+				uint32_t num = readLE<uint32_t>(buf.data() + 4);
+				if(stride < 16) continue;
+				found = true;
+				covered.back() = true;
+				for(uint32_t i = 0; (i < num) && (24 + (size_t)(i + 1) * stride <= buf.size()); ++i)
+				{
+					uint64_t ixoffset = readLE<uint64_t>(buf.data() + 24 + (size_t)i * stride);
+					if(0xffffffffull < ixoffset) continue;
+					istr.clear();
+					istr.seekg((std::streamoff)ixoffset);
+					ChunkHeader hdr = {};
+					if(!istr.read((char*)&hdr, 8).good()) continue;
+					if(!readChunkPayload(istr, ixoffset, hdr.ckid, ixbuf)) continue;
+					entries.push_back({ hdr.ckid, 0, (uint32_t)ixoffset, hdr.cksize });
+					parseStandardIndex(ixbuf.data(), ixbuf.size(), entries);
+				}
+			}
+			return found;
+		}
+		// the entries inside the first movi list, sorted by offset
+		// returns false if there is no usable index, or the index describes nested 'rec ' lists which it cannot represent
+		static bool readIndex(std::istream& istr, const RiffNode& root, std::vector<AviIndexEntry>& entries)
+		{
+			entries.clear();
+			const RiffNode* movi = findMovi(root);
+			if(!movi) return false;
+			std::vector<bool> covered;
+			if(!readOpenDmlIndex(istr, root, entries, covered))
+			{
+				entries.clear();
+				if(!readIdx1(istr, root, entries)) return false;
+			}
+			else if(std::find(covered.begin(), covered.end(), false) != covered.end())
+			{
+				// streams without an indx are taken from idx1, without one the index is incomplete and rejected
+				std::vector<AviIndexEntry> idx1entries;
+				if(!readIdx1(istr, root, idx1entries)) return false;
+				for(const auto& e : idx1entries)
+				{
+					int stream = streamNumber(e.ckid);
+					if((0 <= stream) && ((size_t)stream < covered.size()) && !covered[stream]) entries.push_back(e);
+				}
+			}
+			uint64_t mvbegin = (uint64_t)movi->ckinfo.hdroffset + 12;
+			uint64_t mvend = (uint64_t)movi->ckinfo.hdroffset + 8 + movi->ckinfo.header.cksize;
+			for(const auto& e : entries)
+			{
+				if(e.flags & AVIIF_LIST) return false;
+			}
+			entries.erase(std::remove_if(entries.begin(), entries.end(), [mvbegin, mvend](const AviIndexEntry& e)
+			{
+				return (e.hdroffset < mvbegin) || (mvend < (uint64_t)e.hdroffset + 8 + e.cksize);
+			}), entries.end());
+			std::sort(entries.begin(), entries.end(), [](const AviIndexEntry& a, const AviIndexEntry& b) { return a.hdroffset < b.hdroffset; });
+			entries.erase(std::unique(entries.begin(), entries.end(), [](const AviIndexEntry& a, const AviIndexEntry& b) { return a.hdroffset == b.hdroffset; }), entries.end());
+			return !entries.empty();
+		}
+		// fills the subnodes of an unparsed movi list from the index without scanning it
+		static bool populateMovi(std::istream& istr, RiffNode& root)
+		{
+			RiffNode* movi = const_cast<RiffNode*>(findMovi(root));
+			if(!movi || !movi->subnodes.empty()) return false;
+			std::vector<AviIndexEntry> entries;
+			if(!readIndex(istr, root, entries)) return false;
+			for(const auto& e : entries)
+			{
+				RiffNode& ns = movi->addSubNode(RiffNode(e.ckid));
+				ns.ckinfo.hdroffset = e.hdroffset;
+				ns.ckinfo.header.cksize = e.cksize;
+			}
+			return true;
+		}
+		// the n-th data chunk of a stream in the movi list
+		static const RiffNode* findFrame(const RiffNode& movi, int stream, size_t frame)
+		{
+			const RiffNode* pfound = nullptr;
+			size_t count = 0;
+			bool continueFlag = true;
+			RiffNode::traverseTree(const_cast<RiffNode&>(movi), continueFlag, [&](RiffNode& n, bool& continueFlag)
+			{
+				if(n.ckinfo.header.isContainer() || (streamNumber(n.ckinfo.header.ckid) != stream)) return;
+				if(count++ == frame) { pfound = &n; continueFlag = false; }
+			});
+			return pfound;
+		}
+		static size_t countFrames(const RiffNode& movi, int stream)
+		{
+			size_t count = 0;
+			RiffNode::traverseTree(const_cast<RiffNode&>(movi), [&](RiffNode& n)
+			{
+				if(!n.ckinfo.header.isContainer() && (streamNumber(n.ckinfo.header.ckid) == stream)) ++count;
+			});
+			return count;
+		}
+		// cross-checks the index entries against the chunk headers in the file
+		struct VerifyResult
+		{
+			size_t numChecked = 0;
+			std::vector<AviIndexEntry> mismatches;
+		};
+		static bool verifyIndex(std::istream& istr, const RiffNode& root, VerifyResult& result, std::function<bool(size_t, size_t)> progress = nullptr)
+		{
+			std::vector<AviIndexEntry> entries;
+			if(!readIndex(istr, root, entries)) return false;
+			for(size_t i = 0; i < entries.size(); ++i)
+			{
+				const AviIndexEntry& e = entries[i];
+				ChunkHeader hdr = {};
+				istr.clear();
+				istr.seekg(e.hdroffset);
+				istr.read((char*)&hdr, 8);
+				if(!istr.good() || (hdr.ckid != e.ckid) || (hdr.cksize != e.cksize)) result.mismatches.push_back(e);
+				++result.numChecked;
+				if(progress && !progress(i + 1, entries.size())) return false;
+			}
+			return true;
+		}
+	};
+
+} // namespace riffrw
@@ -0,0 +1,308 @@
+//
+//  riffchunks.h
+//  typed zero-copy views of well-known chunk payloads
+//
+//  created by yu2924 on 2026-10-18
+//
+
+#pragma once
+
+#include "riffrw.h"
+#include <cstring>
+#include <string_view>
+#include <algorithm>
+
+namespace riffrw
+{
+
+	// a non-owning span over a chunk payload with bounds checked little endian accessors
+	struct ChunkSpan
+	{
+		const uint8_t* data;
+		size_t size;
+		ChunkSpan(const void* p = nullptr, size_t c = 0) : data((const uint8_t*)p), size(c)
+		{
+		}
+		template<typename T> T get(size_t off) const
+		{
+			T v = {};
+			if((off <= size) && (sizeof(T) <= size - off)) std::memcpy(&v, data + off, sizeof(T));
+			return v;
+		}
+		FourCC fourcc(size_t off) const
+		{
+			return FourCC(get<uint32_t>(off));
+		}
+		// a fixed length text field, terminated at the first NUL
+		std::string_view text(size_t off, size_t len) const
+		{
+			if(size <= off) return {};
+			const char* p = (const char*)data + off;
+			len = std::min(len, size - off);
+			return std::string_view(p, std::find(p, p + len, '\0') - p);
+		}
+	};
+
+	// each view provides:
+	//   static bool accepts(const ChunkInfo& ck, const ChunkInfo* parent)
+	//   bool isValid() const
+	//   forEachField(f): calls f(std::string_view name, int index, value) for each field, index is -1 for scalar fields,
+	//   value is an integer type, FourCC or std::string_view pointing into the payload
+
+	struct WaveFormatView : ChunkSpan
+	{
+		using ChunkSpan::ChunkSpan;
+		static constexpr FourCC Id = FourCC("fmt ");
+		enum { WAVE_FORMAT_EXTENSIBLE = 0xfffe };
+		static bool accepts(const ChunkInfo& ck, const ChunkInfo*) { return ck.header.ckid == Id; }
+		bool isValid() const { return 14 <= size; }
+		uint16_t formatTag() const { return get<uint16_t>(0); }
+		uint16_t channels() const { return get<uint16_t>(2); }
+		uint32_t samplesPerSec() const { return get<uint32_t>(4); }
+		uint32_t avgBytesPerSec() const { return get<uint32_t>(8); }
+		uint16_t blockAlign() const { return get<uint16_t>(12); }
+		uint16_t bitsPerSample() const { return get<uint16_t>(14); }
+		uint16_t extraSize() const { return get<uint16_t>(16); }
+		bool isExtensible() const { return (formatTag() == WAVE_FORMAT_EXTENSIBLE) && (40 <= size); }
+		uint16_t validBitsPerSample() const { return get<uint16_t>(18); }
+		uint32_t channelMask() const { return get<uint32_t>(20); }
+		uint16_t subFormatTag() const { return get<uint16_t>(24); } // leading word of the SubFormat GUID
+		template<typename F> void forEachField(F&& f) const
+		{
+			f("formatTag", -1, formatTag());
+			f("channels", -1, channels());
+			f("samplesPerSec", -1, samplesPerSec());
+			f("avgBytesPerSec", -1, avgBytesPerSec());
+			f("blockAlign", -1, blockAlign());
+			if(16 <= size) f("bitsPerSample", -1, bitsPerSample());
+			if(18 <= size) f("extraSize", -1, extraSize());
+			if(!isExtensible()) return;
+			f("validBitsPerSample", -1, validBitsPerSample());
+			f("channelMask", -1, channelMask());
+			f("subFormat", -1, subFormatTag());
+		}
+	};
+
+	// EBU Tech 3285 broadcast audio extension
+	struct BextView : ChunkSpan
+	{
+		using ChunkSpan::ChunkSpan;
+		static constexpr FourCC Id = FourCC("bext");
+		static bool accepts(const ChunkInfo& ck, const ChunkInfo*) { return ck.header.ckid == Id; }
+		bool isValid() const { return 602 <= size; }
+		std::string_view description() const { return text(0, 256); }
+		std::string_view originator() const { return text(256, 32); }
+		std::string_view originatorReference() const { return text(288, 32); }
+		std::string_view originationDate() const { return text(320, 10); }
+		std::string_view originationTime() const { return text(330, 8); }
+		uint64_t timeReference() const { return get<uint64_t>(338); }
+		uint16_t version() const { return get<uint16_t>(346); }
+		int16_t loudnessValue() const { return get<int16_t>(412); }
+		int16_t loudnessRange() const { return get<int16_t>(414); }
+		int16_t maxTruePeakLevel() const { return get<int16_t>(416); }
+		int16_t maxMomentaryLoudness() const { return get<int16_t>(418); }
+		int16_t maxShortTermLoudness() const { return get<int16_t>(420); }
+		std::string_view codingHistory() const { return text(602, size); }
+		template<typename F> void forEachField(F&& f) const
+		{
+			f("description", -1, description());
+			f("originator", -1, originator());
+			f("originatorReference", -1, originatorReference());
+			f("originationDate", -1, originationDate());
+			f("originationTime", -1, originationTime());
+			f("timeReference", -1, timeReference());
+			f("version", -1, version());
+			if(2 <= version())
+			{
+				f("loudnessValue", -1, loudnessValue());
+				f("loudnessRange", -1, loudnessRange());
+				f("maxTruePeakLevel", -1, maxTruePeakLevel());
+				f("maxMomentaryLoudness", -1, maxMomentaryLoudness());
+				f("maxShortTermLoudness", -1, maxShortTermLoudness());
+			}
+			f("codingHistory", -1, codingHistory());
+		}
+	};
+
+	struct CueView : ChunkSpan
+	{
+		using ChunkSpan::ChunkSpan;
+		static constexpr FourCC Id = FourCC("cue ");
+		static bool accepts(const ChunkInfo& ck, const ChunkInfo*) { return ck.header.ckid == Id; }
+		bool isValid() const { return 4 <= size; }
+		uint32_t numCuePoints() const { return get<uint32_t>(0); }
+		// clipped to the payload
+		size_t numAvailable() const { return std::min((size_t)numCuePoints(), (size - 4) / 24); }
+		template<typename F> void forEachField(F&& f) const
+		{
+			f("numCuePoints", -1, numCuePoints());
+			for(size_t i = 0; i < numAvailable(); ++i)
+			{
+				size_t off = 4 + i * 24;
+				f("id", (int)i, get<uint32_t>(off));
+				f("position", (int)i, get<uint32_t>(off + 4));
+				f("dataChunkId", (int)i, fourcc(off + 8));
+				f("chunkStart", (int)i, get<uint32_t>(off + 12));
+				f("blockStart", (int)i, get<uint32_t>(off + 16));
+				f("sampleOffset", (int)i, get<uint32_t>(off + 20));
+			}
+		}
+	};
+
+	struct SamplerView : ChunkSpan
+	{
+		using ChunkSpan::ChunkSpan;
+		static constexpr FourCC Id = FourCC("smpl");
+		static bool accepts(const ChunkInfo& ck, const ChunkInfo*) { return ck.header.ckid == Id; }
+		bool isValid() const { return 36 <= size; }
+		uint32_t numSampleLoops() const { return get<uint32_t>(28); }
+		size_t numAvailable() const { return std::min((size_t)numSampleLoops(), (size - 36) / 24); }
+		template<typename F> void forEachField(F&& f) const
+		{
+			f("manufacturer", -1, get<uint32_t>(0));
+			f("product", -1, get<uint32_t>(4));
+			f("samplePeriod", -1, get<uint32_t>(8));
+			f("midiUnityNote", -1, get<uint32_t>(12));
+			f("midiPitchFraction", -1, get<uint32_t>(16));
+			f("smpteFormat", -1, get<uint32_t>(20));
+			f("smpteOffset", -1, get<uint32_t>(24));
+			f("numSampleLoops", -1, numSampleLoops());
+			f("samplerData", -1, get<uint32_t>(32));
+			for(size_t i = 0; i < numAvailable(); ++i)
+			{
+				size_t off = 36 + i * 24;
+				f("cuePointId", (int)i, get<uint32_t>(off));
+				f("type", (int)i, get<uint32_t>(off + 4));
+				f("start", (int)i, get<uint32_t>(off + 8));
+				f("end", (int)i, get<uint32_t>(off + 12));
+				f("fraction", (int)i, get<uint32_t>(off + 16));
+				f("playCount", (int)i, get<uint32_t>(off + 20));
+			}
+		}
+	};
+
+	struct AviMainHeaderView : ChunkSpan
+	{
+		using ChunkSpan::ChunkSpan;
+		static constexpr FourCC Id = FourCC("avih");
+		static bool accepts(const ChunkInfo& ck, const ChunkInfo*) { return ck.header.ckid == Id; }
+		bool isValid() const { return 40 <= size; }
+		uint32_t microSecPerFrame() const { return get<uint32_t>(0); }
+		uint32_t totalFrames() const { return get<uint32_t>(16); }
+		uint32_t streams() const { return get<uint32_t>(24); }
+		uint32_t width() const { return get<uint32_t>(32); }
+		uint32_t height() const { return get<uint32_t>(36); }
+		template<typename F> void forEachField(F&& f) const
+		{
+			f("microSecPerFrame", -1, microSecPerFrame());
+			f("maxBytesPerSec", -1, get<uint32_t>(4));
+			f("paddingGranularity", -1, get<uint32_t>(8));
+			f("flags", -1, get<uint32_t>(12));
+			f("totalFrames", -1, totalFrames());
+			f("initialFrames", -1, get<uint32_t>(20));
+			f("streams", -1, streams());
+			f("suggestedBufferSize", -1, get<uint32_t>(28));
+			f("width", -1, width());
+			f("height", -1, height());
+		}
+	};
+
+	struct AviStreamHeaderView : ChunkSpan
+	{
+		using ChunkSpan::ChunkSpan;
+		static constexpr FourCC Id = FourCC("strh");
+		static bool accepts(const ChunkInfo& ck, const ChunkInfo*) { return ck.header.ckid == Id; }
+		bool isValid() const { return 48 <= size; }
+		FourCC fccType() const { return fourcc(0); }
+		FourCC fccHandler() const { return fourcc(4); }
+		uint32_t scale() const { return get<uint32_t>(20); }
+		uint32_t rate() const { return get<uint32_t>(24); }
+		uint32_t length() const { return get<uint32_t>(32); }
+		template<typename F> void forEachField(F&& f) const
+		{
+			f("fccType", -1, fccType());
+			f("fccHandler", -1, fccHandler());
+			f("flags", -1, get<uint32_t>(8));
+			f("priority", -1, get<uint16_t>(12));
+			f("language", -1, get<uint16_t>(14));
+			f("initialFrames", -1, get<uint32_t>(16));
+			f("scale", -1, scale());
+			f("rate", -1, rate());
+			f("start", -1, get<uint32_t>(28));
+			f("length", -1, length());
+			f("suggestedBufferSize", -1, get<uint32_t>(36));
+			f("quality", -1, get<uint32_t>(40));
+			f("sampleSize", -1, get<uint32_t>(44));
+			if(size < 56) return;
+			f("frame.left", -1, get<int16_t>(48));
+			f("frame.top", -1, get<int16_t>(50));
+			f("frame.right", -1, get<int16_t>(52));
+			f("frame.bottom", -1, get<int16_t>(54));
+		}
+	};
+
+	// the whole LIST.INFO payload: the type field followed by text subchunks, each reported under its own id
+	struct InfoListView : ChunkSpan
+	{
+		using ChunkSpan::ChunkSpan;
+		static bool accepts(const ChunkInfo& ck, const ChunkInfo*) { return (ck.header.ckid == FourCC("LIST")) && (ck.type == FourCC("INFO")); }
+		bool isValid() const { return 4 <= size; }
+		template<typename F> void forEachField(F&& f) const
+		{
+			for(size_t off = 4; off + 8 <= size;)
+			{
+				uint32_t cksize = get<uint32_t>(off + 4);
+				f(std::string_view((const char*)data + off, 4), -1, text(off + 8, cksize));
+				off += 8 + (size_t)cksize + (cksize & 1);
+			}
+		}
+	};
+
+	// a single subchunk of LIST.INFO (INAM, IART, ICMT, ...)
+	struct InfoTextView : ChunkSpan
+	{
+		using ChunkSpan::ChunkSpan;
+		static bool accepts(const ChunkInfo& ck, const ChunkInfo* parent)
+		{
+			return parent && InfoListView::accepts(*parent, nullptr) && !ck.header.isContainer();
+		}
+		bool isValid() const { return true; }
+		template<typename F> void forEachField(F&& f) const
+		{
+			f("text", -1, text(0, size));
+		}
+	};
+
+	// the set of views is fixed at compile time, dispatch is a chain of inlined accepts() tests without allocation
+	template<typename... Views> struct ChunkViewRegistry
+	{
+		// calls f with the first view that accepts the chunk and validates the payload, returns false if there is none
+		template<typename F> static bool visit(const ChunkInfo& ck, const ChunkInfo* parent, const void* p, size_t c, F&& f)
+		{
+			return (visitAs<Views>(ck, parent, p, c, f) || ...);
+		}
+		template<typename V, typename F> static bool visitAs(const ChunkInfo& ck, const ChunkInfo* parent, const void* p, size_t c, F& f)
+		{
+			if(!V::accepts(ck, parent)) return false;
+			V v(p, c);
+			if(!v.isValid()) return false;
+			f(v);
+			return true;
+		}
+		static bool accepts(const ChunkInfo& ck, const ChunkInfo* parent)
+		{
+			return (Views::accepts(ck, parent) || ...);
+		}
+		template<typename F> static bool decodeFields(const ChunkInfo& ck, const ChunkInfo* parent, const void* p, size_t c, F&& f)
+		{
+			return visit(ck, parent, p, c, [&f](const auto& v) { v.forEachField(f); });
+		}
+		template<typename F> static bool decodeFields(const RiffNode& n, const void* p, size_t c, F&& f)
+		{
+			return decodeFields(n.ckinfo, n.parent ? &n.parent->ckinfo : nullptr, p, c, f);
+		}
+	};
+
+	using ChunkViews = ChunkViewRegistry<WaveFormatView, BextView, CueView, SamplerView, AviMainHeaderView, AviStreamHeaderView, InfoListView, InfoTextView>;
+
+} // namespace riffrw
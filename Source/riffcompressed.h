@@ -0,0 +1,308 @@
+//
+//  riffcompressed.h
+//  random access reading of block compressed files (seekable zstd, BGZF gzip)
+//
+//  created by yu2924 on 2026-10-18
+//
+
+#pragma once
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <list>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <streambuf>
+#include <istream>
+
+namespace riffrw
+{
+
+	struct CompressedBlock
+	{
+		uint64_t coffset;
+		uint64_t uoffset;
+		uint32_t csize;
+		uint32_t usize;
+	};
+
+	// the table of independently decompressible blocks
+	struct CompressedIndex
+	{
+		enum Format
+		{
+			Uncompressed,
+			Gzip,			// single member gzip, no random access
+			Bgzf,			// blocked gzip (bgzip), each member carries its compressed size in the 'BC' extra field
+			Zstd,			// zstd without a seek table, no random access
+			SeekableZstd,	// zstd frames followed by a seek table in a skippable frame
+		};
+		enum
+		{
+			ZstdFrameMagic = 0xfd2fb528,
+			ZstdSeekTableMagic = 0x184d2a5e,
+			ZstdSeekableFooterMagic = 0x8f92eab1,
+			MaxBlockSize = 256 << 20,
+			BgzfMaxBlockSize = 65536,	// both the compressed member and its uncompressed data (ISIZE)
+		};
+		Format format = Uncompressed;
+		std::vector<CompressedBlock> blocks;
+		template<typename T> static T readLE(const uint8_t* p)
+		{
+			T v;
+			std::memcpy(&v, p, sizeof(v));
+			return v;
+		}
+		static bool readAt(std::istream& istr, uint64_t pos, void* p, size_t c)
+		{
+			istr.clear();
+			istr.seekg((std::streamoff)pos);
+			return istr.read((char*)p, c).good();
+		}
+		static uint64_t streamSize(std::istream& istr)
+		{
+			istr.clear();
+			istr.seekg(0, std::ios::end);
+			uint64_t size = (uint64_t)istr.tellg();
+			istr.seekg(0);
+			return size;
+		}
+		uint64_t totalSize() const
+		{
+			return blocks.empty() ? 0 : (blocks.back().uoffset + blocks.back().usize);
+		}
+		// gzip member header with the 'BC' subfield: returns the total member size
+		static bool readBgzfMember(std::istream& istr, uint64_t pos, uint32_t* pbsize, uint32_t* pisize)
+		{
+			uint8_t hdr[12];
+			if(!readAt(istr, pos, hdr, sizeof(hdr))) return false;
+			if((hdr[0] != 0x1f) || (hdr[1] != 0x8b) || (hdr[2] != 8) || !(hdr[3] & 0x04)) return false;
+			std::vector<uint8_t> extra(readLE<uint16_t>(hdr + 10));
+			if(!istr.read((char*)extra.data(), extra.size()).good()) return false;
+			for(size_t i = 0; i + 4 <= extra.size();)
+			{
+				uint16_t slen = readLE<uint16_t>(extra.data() + i + 2);
+				if((extra[i] == 'B') && (extra[i + 1] == 'C') && (slen == 2) && (i + 6 <= extra.size()))
+				{
+					*pbsize = (uint32_t)readLE<uint16_t>(extra.data() + i + 4) + 1;
+					if(*pbsize < 12 + extra.size() + 8) return false;
+					uint8_t isize[4];
+					if(!readAt(istr, pos + *pbsize - 4, isize, 4)) return false;
+					*pisize = readLE<uint32_t>(isize);
+					return *pisize <= BgzfMaxBlockSize;
+				}
+				i += 4 + slen;
+			}
+			return false;
+		}
+		// walks the member headers, or reads the bgzip .gzi index (pairs of compressed and uncompressed offsets, without the first block) if given
+		static bool readBgzf(std::istream& istr, CompressedIndex& index, const std::filesystem::path& gzipath = {})
+		{
+			index.blocks.clear();
+			uint64_t filesize = streamSize(istr);
+			uint64_t pos = 0, uoff = 0;
+			std::fstream gzi;
+			if(!gzipath.empty()) gzi.open(gzipath, std::ios::in | std::ios::binary);
+			if(gzi.is_open())
+			{
+				uint8_t buf[16];
+				if(!gzi.read((char*)buf, 8).good()) return false;
+				uint64_t num = readLE<uint64_t>(buf);
+				std::vector<std::pair<uint64_t, uint64_t>> offsets = { { 0, 0 } };
+				for(uint64_t i = 0; i < num; ++i)
+				{
+					if(!gzi.read((char*)buf, 16).good()) return false;
+					offsets.push_back({ readLE<uint64_t>(buf), readLE<uint64_t>(buf + 8) });
+				}
+				for(size_t i = 0; i + 1 < offsets.size(); ++i)
+				{
+					uint64_t csize = offsets[i + 1].first - offsets[i].first, usize = offsets[i + 1].second - offsets[i].second;
+					if((BgzfMaxBlockSize < csize) || (BgzfMaxBlockSize < usize)) return false;
+					if(usize) index.blocks.push_back({ offsets[i].first, offsets[i].second, (uint32_t)csize, (uint32_t)usize });
+				}
+				pos = offsets.back().first;
+				uoff = offsets.back().second;
+			}
+			while(pos < filesize)
+			{
+				uint32_t bsize = 0, isize = 0;
+				if(!readBgzfMember(istr, pos, &bsize, &isize) || (filesize - pos < bsize)) return false;
+				if(isize) index.blocks.push_back({ pos, uoff, bsize, isize });
+				pos += bsize;
+				uoff += isize;
+			}
+			index.format = Bgzf;
+			return true;
+		}
+		// seek table: skippable frame { magic, size, entries { csize, dsize [, checksum] }, footer { numframes, descriptor, magic } }
+		static bool readSeekableZstd(std::istream& istr, CompressedIndex& index)
+		{
+			index.blocks.clear();
+			uint64_t filesize = streamSize(istr);
+			uint8_t footer[9];
+			if((filesize < 17) || !readAt(istr, filesize - 9, footer, 9)) return false;
+			if(readLE<uint32_t>(footer + 5) != ZstdSeekableFooterMagic) return false;
+			uint32_t num = readLE<uint32_t>(footer);
+			size_t esize = (footer[4] & 0x80) ? 12 : 8;
+			uint64_t tablesize = (uint64_t)num * esize;
+			if(filesize < tablesize + 17) return false;
+			uint64_t tablepos = filesize - 9 - tablesize;
+			uint8_t skhdr[8];
+			if(!readAt(istr, tablepos - 8, skhdr, 8) || (readLE<uint32_t>(skhdr) != ZstdSeekTableMagic) || (readLE<uint32_t>(skhdr + 4) != tablesize + 9)) return false;
+			std::vector<uint8_t> table((size_t)tablesize);
+			if(!readAt(istr, tablepos, table.data(), table.size())) return false;
+			uint64_t coff = 0, uoff = 0;
+			for(uint32_t i = 0; i < num; ++i)
+			{
+				uint32_t csize = readLE<uint32_t>(table.data() + i * esize), usize = readLE<uint32_t>(table.data() + i * esize + 4);
+				if((MaxBlockSize < csize) || (MaxBlockSize < usize)) return false;
+				if(usize) index.blocks.push_back({ coff, uoff, csize, usize });
+				coff += csize;
+				uoff += usize;
+			}
+			if(tablepos - 8 < coff) return false;
+			index.format = SeekableZstd;
+			return true;
+		}
+		static Format detect(std::istream& istr)
+		{
+			uint8_t magic[4] = {};
+			if(!readAt(istr, 0, magic, 4)) return Uncompressed;
+			if((magic[0] == 0x1f) && (magic[1] == 0x8b))
+			{
+				uint32_t bsize, isize;
+				return readBgzfMember(istr, 0, &bsize, &isize) ? Bgzf : Gzip;
+			}
+			if(readLE<uint32_t>(magic) == ZstdFrameMagic)
+			{
+				CompressedIndex index;
+				return readSeekableZstd(istr, index) ? SeekableZstd : Zstd;
+			}
+			return Uncompressed;
+		}
+		static bool build(std::istream& istr, CompressedIndex& index, const std::filesystem::path& gzipath = {})
+		{
+			index = {};
+			index.format = detect(istr);
+			switch(index.format)
+			{
+				case Bgzf: return readBgzf(istr, index, gzipath);
+				case SeekableZstd: return readSeekableZstd(istr, index);
+				default: return index.format == Uncompressed;
+			}
+		}
+	};
+
+	// decompresses exactly one block: src/srclen is the compressed block, dst/dstlen receives CompressedBlock::usize bytes
+	using BlockDecoder = std::function<bool(const void* src, size_t srclen, void* dst, size_t dstlen)>;
+
+	// a seekable read-only view of the uncompressed content, decompressing only the blocks touched, with an LRU cache of decompressed blocks
+	class CompressedStreamBuf : public std::streambuf
+	{
+	protected:
+		struct CachedBlock
+		{
+			size_t iblock;
+			std::vector<char> data;
+		};
+		std::unique_ptr<std::istream> source;
+		std::shared_ptr<const CompressedIndex> index;
+		BlockDecoder decoder;
+		std::list<CachedBlock> cache; // most recently used first
+		size_t cacheBytes = 0;
+		size_t cacheBudget;
+		std::vector<char> cbuf;
+		uint64_t curbase = 0; // uncompressed offset of eback(), or the position if there is no get area
+		const std::vector<char>* loadBlock(size_t iblock)
+		{
+			for(auto it = cache.begin(); it != cache.end(); ++it)
+			{
+				if(it->iblock == iblock)
+				{
+					cache.splice(cache.begin(), cache, it);
+					return &cache.front().data;
+				}
+			}
+			const CompressedBlock& blk = index->blocks[iblock];
+			cbuf.resize(blk.csize);
+			if(!CompressedIndex::readAt(*source, blk.coffset, cbuf.data(), cbuf.size())) return nullptr;
+			std::vector<char> data(blk.usize);
+			if(!decoder || !decoder(cbuf.data(), cbuf.size(), data.data(), data.size())) return nullptr;
+			cacheBytes += data.size();
+			cache.push_front({ iblock, std::move(data) });
+			// the front block backs the get area and is never evicted
+			while((cacheBudget < cacheBytes) && (1 < cache.size()))
+			{
+				cacheBytes -= cache.back().data.size();
+				cache.pop_back();
+			}
+			return &cache.front().data;
+		}
+		uint64_t currentPosition() const
+		{
+			return eback() ? (curbase + (uint64_t)(gptr() - eback())) : curbase;
+		}
+		virtual int_type underflow() override
+		{
+			if(gptr() < egptr()) return traits_type::to_int_type(*gptr());
+			uint64_t pos = currentPosition();
+			setg(nullptr, nullptr, nullptr);
+			curbase = pos;
+			const std::vector<CompressedBlock>& blocks = index->blocks;
+			auto it = std::upper_bound(blocks.begin(), blocks.end(), pos, [](uint64_t p, const CompressedBlock& b) { return p < b.uoffset; });
+			if(it == blocks.begin()) return traits_type::eof();
+			size_t iblock = (size_t)(it - blocks.begin()) - 1;
+			const CompressedBlock& blk = blocks[iblock];
+			if(blk.uoffset + blk.usize <= pos) return traits_type::eof();
+			const std::vector<char>* data = loadBlock(iblock);
+			if(!data) return traits_type::eof();
+			char* p = const_cast<char*>(data->data());
+			setg(p, p + (pos - blk.uoffset), p + data->size());
+			curbase = blk.uoffset;
+			return traits_type::to_int_type(*gptr());
+		}
+		virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+		{
+			if(!(which & std::ios_base::in)) return pos_type(off_type(-1));
+			int64_t base = (dir == std::ios_base::beg) ? 0 : (dir == std::ios_base::cur) ? (int64_t)currentPosition() : (int64_t)index->totalSize();
+			int64_t pos = base + (int64_t)off;
+			// like a file stream, positions past the end are valid and read as EOF (e.g. the pad of an odd last chunk)
+			if(pos < 0) return pos_type(off_type(-1));
+			if(eback() && (curbase <= (uint64_t)pos) && ((uint64_t)pos < curbase + (uint64_t)(egptr() - eback())))
+			{
+				setg(eback(), eback() + (pos - curbase), egptr());
+			}
+			else
+			{
+				setg(nullptr, nullptr, nullptr);
+				curbase = (uint64_t)pos;
+			}
+			return pos_type(off_type(pos));
+		}
+		virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+		{
+			return seekoff(off_type(pos), std::ios_base::beg, which);
+		}
+	public:
+		CompressedStreamBuf(std::unique_ptr<std::istream> src, std::shared_ptr<const CompressedIndex> idx, BlockDecoder dec, size_t budget = 64 << 20)
+			: source(std::move(src)), index(std::move(idx)), decoder(std::move(dec)), cacheBudget(budget)
+		{
+		}
+	};
+
+	class CompressedInputStream : public std::istream
+	{
+	protected:
+		CompressedStreamBuf buffer;
+	public:
+		CompressedInputStream(std::unique_ptr<std::istream> src, std::shared_ptr<const CompressedIndex> idx, BlockDecoder dec, size_t budget = 64 << 20)
+			: std::istream(nullptr), buffer(std::move(src), std::move(idx), std::move(dec), budget)
+		{
+			rdbuf(&buffer);
+		}
+	};
+
+} // namespace riffrw
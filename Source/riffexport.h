@@ -0,0 +1,187 @@
+//
+//  riffexport.h
+//  bulk chunk export
+//
+//  created by yu2924 on 2026-10-18
+//
+
+#pragma once
+
+#include "riffrw.h"
+#include "riffquery.h"
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+
+namespace riffrw
+{
+
+	// reads the payloads of many chunks sorted by file offset
+	// a reader thread fetches coalesced spans in large blocks while the calling thread hands the data to the sink
+	struct ChunkExport
+	{
+		static constexpr size_t BlockSize = 4 << 20;
+		static constexpr uint64_t MaxGap = 64 << 10;
+		static constexpr size_t QueueDepth = 2;
+		struct Item
+		{
+			uint64_t offset;
+			uint32_t size;
+			const RiffNode* node;
+			uint64_t end() const { return offset + size; }
+		};
+		// sorted by offset, a chunk nested in an already selected chunk is dropped since its data is exported with the outer one
+		static std::vector<Item> selectItems(const RiffNode& root, const Query& query)
+		{
+			std::vector<Item> all;
+			query.select(root, [&all](const RiffNode& n)
+			{
+				all.push_back({ (uint64_t)n.ckinfo.hdroffset + 8, n.ckinfo.header.cksize, &n });
+			});
+			std::stable_sort(all.begin(), all.end(), [](const Item& a, const Item& b) { return a.offset < b.offset; });
+			std::vector<Item> items;
+			uint64_t lastend = 0;
+			for(const auto& it : all)
+			{
+				if(!items.empty() && (it.offset < lastend)) continue;
+				items.push_back(it);
+				lastend = it.end();
+			}
+			return items;
+		}
+		static uint64_t totalSize(const std::vector<Item>& items)
+		{
+			uint64_t c = 0;
+			for(const auto& it : items) c += it.size;
+			return c;
+		}
+		// the sink is called one or more times for each item in order, at least once with c == 0 for an empty chunk
+		static bool transfer(std::istream& istr, const std::vector<Item>& items, std::function<bool(size_t iitem, const void* p, size_t c)> sink)
+		{
+			struct Block { uint64_t offset = 0; std::vector<char> data; bool ok = true; };
+			std::mutex mutex;
+			std::condition_variable cv;
+			std::deque<Block> filled, spare;
+			std::atomic<bool> abort{ false };
+			bool done = false;
+			std::thread reader([&]()
+			{
+				size_t i = 0;
+				bool ok = true;
+				while(ok && (i < items.size()) && !abort)
+				{
+					// merge nearby items into one span, skipping small gaps by reading through them
+					uint64_t spanbegin = items[i].offset, spanend = items[i].end();
+					for(++i; i < items.size() && (items[i].offset <= spanend + MaxGap); ++i) spanend = std::max(spanend, items[i].end());
+					istr.clear();
+					istr.seekg((std::streamoff)spanbegin);
+					for(uint64_t pos = spanbegin; ok && (pos < spanend) && !abort;)
+					{
+						Block blk;
+						{
+							std::unique_lock<std::mutex> lock(mutex);
+							cv.wait(lock, [&]() { return (filled.size() < QueueDepth) || abort; });
+							if(abort) break;
+							if(!spare.empty()) { blk = std::move(spare.front()); spare.pop_front(); }
+						}
+						size_t lseg = (size_t)std::min(spanend - pos, (uint64_t)BlockSize);
+						blk.offset = pos;
+						blk.data.resize(lseg);
+						istr.read(blk.data.data(), lseg);
+						blk.ok = ok = ((size_t)istr.gcount() == lseg);
+						pos += lseg;
+						std::lock_guard<std::mutex> lock(mutex);
+						filled.push_back(std::move(blk));
+						cv.notify_all();
+					}
+				}
+				std::lock_guard<std::mutex> lock(mutex);
+				done = true;
+				cv.notify_all();
+			});
+			size_t inext = 0;
+			bool ok = true;
+			while(ok)
+			{
+				Block blk;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					cv.wait(lock, [&]() { return !filled.empty() || done; });
+					if(filled.empty()) break;
+					blk = std::move(filled.front());
+					filled.pop_front();
+					cv.notify_all();
+				}
+				if(!blk.ok) { ok = false; break; }
+				uint64_t b0 = blk.offset, b1 = blk.offset + blk.data.size();
+				while(ok && (inext < items.size()) && (items[inext].offset < b1))
+				{
+					const Item& it = items[inext];
+					uint64_t o0 = std::max(it.offset, b0), o1 = std::min(it.end(), b1);
+					if((o0 < o1) || !it.size) ok = sink(inext, blk.data.data() + (o0 - b0), (size_t)(std::max(o0, o1) - o0));
+					if(it.end() <= b1) ++inext;
+					else break;
+				}
+				std::lock_guard<std::mutex> lock(mutex);
+				spare.push_back(std::move(blk));
+			}
+			// empty chunks past the last span
+			for(; ok && (inext < items.size()) && !items[inext].size; ++inext) ok = sink(inext, nullptr, 0);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				abort = true;
+				cv.notify_all();
+			}
+			reader.join();
+			return ok && (inext == items.size());
+		}
+		static std::string itemFileName(size_t iitem, const Item& it)
+		{
+			std::string fn = it.node->ckinfo.pathElement();
+			std::replace(fn.begin(), fn.end(), ' ', '_');
+			std::string num = std::to_string(iitem);
+			if(num.size() < 6) num.insert(0, 6 - num.size(), '0');
+			return num + "_" + fn + ".riffck";
+		}
+		// one file per chunk
+		static bool exportToDirectory(std::istream& istr, const std::vector<Item>& items, const std::filesystem::path& outdir, std::function<bool(uint64_t)> progress = nullptr)
+		{
+			std::error_code ec;
+			std::filesystem::create_directories(outdir, ec);
+			std::fstream ostr;
+			size_t icur = items.size();
+			uint64_t written = 0;
+			bool ok = transfer(istr, items, [&](size_t iitem, const void* p, size_t c)
+			{
+				if(iitem != icur)
+				{
+					if(ostr.is_open()) ostr.close();
+					ostr.open(outdir / itemFileName(iitem, items[iitem]), std::ios::out | std::ios::binary | std::ios::trunc);
+					icur = iitem;
+				}
+				if(!ostr.write((const char*)p, c).good()) return false;
+				written += c;
+				return !progress || progress(written);
+			});
+			if(!ostr.is_open()) return ok;
+			ostr.close();
+			return ok && !ostr.fail();
+		}
+		// all chunks concatenated into one stream
+		static bool exportToStream(std::istream& istr, const std::vector<Item>& items, std::ostream& ostr, std::function<bool(uint64_t)> progress = nullptr)
+		{
+			uint64_t written = 0;
+			bool ok = transfer(istr, items, [&](size_t, const void* p, size_t c)
+			{
+				if(!ostr.write((const char*)p, c).good()) return false;
+				written += c;
+				return !progress || progress(written);
+			});
+			return ok && ostr.flush().good();
+		}
+	};
+
+} // namespace riffrw
@@ -0,0 +1,170 @@
+//
+//  riffindex.h
+//  persistent structure index of the parsed chunk tree
+//
+//  created by yu2924 on 2026-10-18
+//
+
+#pragma once
+
+#include "riffrw.h"
+#include "riffcompressed.h"
+#include <cstring>
+
+namespace riffrw
+{
+
+	// binary image layout (little endian, fixed size records, no pointers, so the image can be used directly from a memory mapped file):
+	//   IndexFileHeader
+	//   IndexRecord[recordcount] in depth-first pre-order
+	//   CompressedBlock[blockcount] of a block compressed source, so that reopening it does not walk the blocks again
+	struct IndexKey
+	{
+		uint64_t pathhash;
+		uint64_t filesize;
+		int64_t mtime;
+		uint64_t checksum;
+		bool operator==(const IndexKey& o) const
+		{
+			return (pathhash == o.pathhash) && (filesize == o.filesize) && (mtime == o.mtime) && (checksum == o.checksum);
+		}
+		bool operator!=(const IndexKey& o) const { return !(*this == o); }
+	};
+
+	struct IndexFileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t recordcount;
+		IndexKey key;
+		uint32_t format;	// CompressedIndex::Format
+		uint32_t blockcount;
+	};
+
+	struct IndexRecord
+	{
+		uint32_t hdroffset;
+		uint32_t ckid;
+		uint32_t cksize;
+		uint32_t type;
+		uint32_t numsubnodes;
+	};
+
+	struct RiffIndex
+	{
+		static constexpr char Magic[8] = { 'R', 'I', 'F', 'F', 'V', 'I', 'D', 'X' };
+		static constexpr uint32_t Version = 2;
+		static constexpr size_t ChecksumLength = 65536;
+		static constexpr int MaxDepth = 256;
+		// FNV-1a over the leading bytes of the source, which covers the top level chunk headers
+		static uint64_t computeChecksum(const void* p, size_t c, uint64_t h = 0xcbf29ce484222325ull)
+		{
+			const uint8_t* pb = (const uint8_t*)p;
+			for(size_t i = 0; i < c; ++i) { h ^= pb[i]; h *= 0x100000001b3ull; }
+			return h;
+		}
+		static uint64_t computeChecksum(std::istream& istr)
+		{
+			std::vector<char> buf(ChecksumLength);
+			istr.seekg(0);
+			istr.read(buf.data(), buf.size());
+			size_t c = (size_t)istr.gcount();
+			istr.clear();
+			istr.seekg(0);
+			return computeChecksum(buf.data(), c);
+		}
+		static uint64_t computeChecksum(const std::string& s)
+		{
+			return computeChecksum(s.data(), s.size());
+		}
+		// serialize
+		static void flattenTree(const RiffNode& n, std::vector<IndexRecord>& records)
+		{
+			records.push_back({ n.ckinfo.hdroffset, n.ckinfo.header.ckid, n.ckinfo.header.cksize, n.ckinfo.type, (uint32_t)n.subnodes.size() });
+			for(const auto& ns : n.subnodes) flattenTree(ns, records);
+		}
+		static bool writeIndexToStream(const RiffNode& n, const IndexKey& key, std::ostream& ostr, const CompressedIndex* cindex = nullptr)
+		{
+			std::vector<IndexRecord> records;
+			flattenTree(n, records);
+			IndexFileHeader hdr = {};
+			std::memcpy(hdr.magic, Magic, sizeof(hdr.magic));
+			hdr.version = Version;
+			hdr.recordcount = (uint32_t)records.size();
+			hdr.key = key;
+			hdr.format = cindex ? (uint32_t)cindex->format : (uint32_t)CompressedIndex::Uncompressed;
+			hdr.blockcount = cindex ? (uint32_t)cindex->blocks.size() : 0;
+			ostr.write((const char*)&hdr, sizeof(hdr));
+			ostr.write((const char*)records.data(), records.size() * sizeof(IndexRecord));
+			if(cindex) ostr.write((const char*)cindex->blocks.data(), cindex->blocks.size() * sizeof(CompressedBlock));
+			return ostr.good();
+		}
+		static bool writeIndexToFile(const RiffNode& n, const IndexKey& key, const std::filesystem::path& outpath, const CompressedIndex* cindex = nullptr)
+		{
+			std::error_code ec;
+			std::filesystem::create_directories(outpath.parent_path(), ec);
+			// write aside and rename, so that a concurrent reader never sees a partial image
+			std::filesystem::path tmppath = outpath;
+			tmppath += ".tmp";
+			{
+				std::fstream ostr(tmppath, std::ios::out | std::ios::binary | std::ios::trunc);
+				if(!ostr.good()) return false;
+				if(!writeIndexToStream(n, key, ostr, cindex)) { ostr.close(); std::filesystem::remove(tmppath, ec); return false; }
+			}
+			std::filesystem::rename(tmppath, outpath, ec);
+			if(ec) { std::filesystem::remove(tmppath, ec); return false; }
+			return true;
+		}
+		// deserialize
+		static bool unflattenTree(const uint8_t*& p, const uint8_t* end, RiffNode* pn, int depth)
+		{
+			if(MaxDepth < depth) return false;
+			if((size_t)(end - p) < sizeof(IndexRecord)) return false;
+			IndexRecord r;
+			std::memcpy(&r, p, sizeof(r));
+			p += sizeof(r);
+			pn->ckinfo.hdroffset = r.hdroffset;
+			pn->ckinfo.header.ckid = r.ckid;
+			pn->ckinfo.header.cksize = r.cksize;
+			pn->ckinfo.type = r.type;
+			if(!pn->ckinfo.header.isContainer() && r.numsubnodes) return false;
+			if((size_t)(end - p) / sizeof(IndexRecord) < r.numsubnodes) return false;
+			for(uint32_t i = 0; i < r.numsubnodes; ++i)
+			{
+				RiffNode& ns = pn->addSubNode({});
+				if(!unflattenTree(p, end, &ns, depth + 1)) return false;
+			}
+			return true;
+		}
+		// validates the image against the expected key; returns false if the image is stale or malformed, in which case the caller should parse the source
+		// pcindex receives the block table, its format is Uncompressed if the source is not block compressed
+		static bool readTreeFromIndexImage(const void* data, size_t size, const IndexKey& key, RiffNode* pn, CompressedIndex* pcindex = nullptr)
+		{
+			if(!data || (size < sizeof(IndexFileHeader))) return false;
+			IndexFileHeader hdr;
+			std::memcpy(&hdr, data, sizeof(hdr));
+			if(std::memcmp(hdr.magic, Magic, sizeof(hdr.magic)) != 0) return false;
+			if(hdr.version != Version) return false;
+			if(hdr.key != key) return false;
+			if(!hdr.recordcount || (hdr.format > CompressedIndex::SeekableZstd)) return false;
+			if(size - sizeof(hdr) != (uint64_t)hdr.recordcount * sizeof(IndexRecord) + (uint64_t)hdr.blockcount * sizeof(CompressedBlock)) return false;
+			const uint8_t* p = (const uint8_t*)data + sizeof(hdr);
+			const uint8_t* end = p + (size_t)hdr.recordcount * sizeof(IndexRecord);
+			RiffNode n = {};
+			if(!unflattenTree(p, end, &n, 0) || (p != end)) return false;
+			if(pcindex)
+			{
+				pcindex->format = (CompressedIndex::Format)hdr.format;
+				pcindex->blocks.resize(hdr.blockcount);
+				if(hdr.blockcount) std::memcpy(pcindex->blocks.data(), end, pcindex->blocks.size() * sizeof(CompressedBlock));
+				for(const auto& blk : pcindex->blocks)
+				{
+					if((CompressedIndex::MaxBlockSize < blk.csize) || (CompressedIndex::MaxBlockSize < blk.usize)) return false;
+				}
+			}
+			*pn = std::move(n);
+			return true;
+		}
+	};
+
+} // namespace riffrw
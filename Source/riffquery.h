@@ -0,0 +1,377 @@
+//
+//  riffquery.h
+//  chunk path query
+//
+//  created by yu2924 on 2026-10-18
+//
+
+#pragma once
+
+#include "riffrw.h"
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include <mutex>
+
+namespace riffrw
+{
+
+	// query syntax:
+	//   /RIFF.WAVE/data          steps separated by '/', a leading '/' matches from the root
+	//   LIST.movi/00dc           without a leading '/', the first step matches at any depth
+	//   //LIST.INFO//I*          '//' matches at any depth below the previous step
+	//   {00dc,01wb}              a set of alternatives, each of which may be a glob
+	//   00??, *                  globs on the path element ("ckid" or "ckid.type") with '*' and '?'
+	//   00dc[size>4096]          predicates: size (payload) or offset (header), with < <= > >= = != and decimal or 0x numbers
+	//   00dc[10], 00dc[10:20]    index range [begin:end) among the siblings that pass the name test, either bound may be omitted
+	// a query compiles once into a matcher whose states prune every subtree that cannot contain a match
+	class Query
+	{
+		friend class QueryDescendEvaluator;
+	public:
+		struct Predicate
+		{
+			enum Kind { Size, Offset, Index } kind;
+			enum Op { LT, LE, GT, GE, EQ, NE } op;
+			int64_t value;
+			int64_t end; // Index: exclusive end, or -1 if open
+		};
+		struct Step
+		{
+			bool descendant = false;
+			std::vector<std::string> names;
+			std::vector<Predicate> predicates;
+			bool hasIndex = false;
+		};
+		using StateSet = uint64_t;
+		enum { MaxSteps = 64 };
+	protected:
+		std::vector<Step> steps;
+		std::string error;
+		static StateSet bit(size_t k) { return (StateSet)1 << k; }
+		static bool parseNumber(const std::string& s, int64_t* pv)
+		{
+			if(s.empty()) return false;
+			char* end = nullptr;
+			long long v = std::strtoll(s.c_str(), &end, 0);
+			if(*end) return false;
+			*pv = v;
+			return true;
+		}
+		bool parsePredicate(const std::string& s, Predicate* pp)
+		{
+			for(auto kind : { std::make_pair("size", Predicate::Size), std::make_pair("offset", Predicate::Offset) })
+			{
+				std::string key = kind.first;
+				if(s.compare(0, key.size(), key) != 0) continue;
+				std::string rest = s.substr(key.size());
+				static const std::pair<const char*, Predicate::Op> ops[] =
+				{
+					{ "<=", Predicate::LE }, { ">=", Predicate::GE }, { "!=", Predicate::NE }, { "==", Predicate::EQ },
+					{ "<", Predicate::LT }, { ">", Predicate::GT }, { "=", Predicate::EQ },
+				};
+				for(const auto& op : ops)
+				{
+					std::string so = op.first;
+					if(rest.compare(0, so.size(), so) != 0) continue;
+					*pp = { kind.second, op.second, 0, -1 };
+					return parseNumber(rest.substr(so.size()), &pp->value);
+				}
+				return false;
+			}
+			*pp = { Predicate::Index, Predicate::EQ, 0, -1 };
+			size_t colon = s.find(':');
+			if(colon == std::string::npos)
+			{
+				if(!parseNumber(s, &pp->value)) return false;
+				pp->end = pp->value + 1;
+			}
+			else
+			{
+				std::string sb = s.substr(0, colon), se = s.substr(colon + 1);
+				if(!sb.empty() && !parseNumber(sb, &pp->value)) return false;
+				if(!se.empty() && !parseNumber(se, &pp->end)) return false;
+			}
+			return (0 <= pp->value);
+		}
+		bool parseStep(const std::string& s, size_t& pos, Step* pst)
+		{
+			size_t end = s.find_first_of("[/", pos);
+			if(end == std::string::npos) end = s.size();
+			std::string name = s.substr(pos, end - pos);
+			pos = end;
+			if(name.empty()) { error = "empty step"; return false; }
+			if((name.front() == '{') && (name.back() == '}'))
+			{
+				std::string body = name.substr(1, name.size() - 2);
+				for(size_t i = 0; i <= body.size();)
+				{
+					size_t j = std::min(body.find(',', i), body.size());
+					if(i == j) { error = "empty alternative in " + name; return false; }
+					pst->names.push_back(body.substr(i, j - i));
+					i = j + 1;
+				}
+			}
+			else
+			{
+				pst->names.push_back(name);
+			}
+			while((pos < s.size()) && (s[pos] == '['))
+			{
+				size_t close = s.find(']', pos);
+				if(close == std::string::npos) { error = "missing ]"; return false; }
+				Predicate pr;
+				std::string text = s.substr(pos + 1, close - pos - 1);
+				if(!parsePredicate(text, &pr)) { error = "invalid predicate [" + text + "]"; return false; }
+				if(pr.kind == Predicate::Index) pst->hasIndex = true;
+				pst->predicates.push_back(pr);
+				pos = close + 1;
+			}
+			return true;
+		}
+		static bool globMatch(const char* p, const char* s)
+		{
+			const char* pstar = nullptr; const char* sstar = nullptr;
+			while(*s)
+			{
+				if((*p == '?') || (*p == *s)) { ++p; ++s; }
+				else if(*p == '*') { pstar = p++; sstar = s; }
+				else if(pstar) { p = pstar + 1; s = ++sstar; }
+				else return false;
+			}
+			while(*p == '*') ++p;
+			return !*p;
+		}
+		static bool nameMatches(const Step& st, const RiffNode& n)
+		{
+			// the path element without allocating: "ckid" or "ckid.type"
+			char e[10] = {};
+			std::memcpy(e, &n.ckinfo.header.ckid, 4);
+			if(n.ckinfo.header.isContainer()) { e[4] = '.'; std::memcpy(e + 5, &n.ckinfo.type, 4); }
+			for(const auto& name : st.names) { if(globMatch(name.c_str(), e)) return true; }
+			return false;
+		}
+		static bool predicatesMatch(const Step& st, const RiffNode& n, size_t index)
+		{
+			for(const auto& pr : st.predicates)
+			{
+				if(pr.kind == Predicate::Index)
+				{
+					if(((int64_t)index < pr.value) || ((0 <= pr.end) && (pr.end <= (int64_t)index))) return false;
+					continue;
+				}
+				int64_t v = (pr.kind == Predicate::Size) ? (int64_t)n.ckinfo.header.cksize : (int64_t)n.ckinfo.hdroffset;
+				bool r = false;
+				switch(pr.op)
+				{
+					case Predicate::LT: r = v < pr.value; break;
+					case Predicate::LE: r = v <= pr.value; break;
+					case Predicate::GT: r = v > pr.value; break;
+					case Predicate::GE: r = v >= pr.value; break;
+					case Predicate::EQ: r = v == pr.value; break;
+					case Predicate::NE: r = v != pr.value; break;
+				}
+				if(!r) return false;
+			}
+			return true;
+		}
+		// evaluates node n with the states inherited from its parent and returns the states for its subnodes
+		// indices[k] is the position of n among its siblings passing the name test of step k
+		StateSet advance(StateSet states, const RiffNode& n, const size_t* indices, bool& matched) const
+		{
+			StateSet next = 0;
+			matched = false;
+			for(size_t k = 0; states && (k < steps.size()); ++k)
+			{
+				if(!(states & bit(k))) continue;
+				const Step& st = steps[k];
+				if(st.descendant) next |= bit(k);
+				if(!nameMatches(st, n) || !predicatesMatch(st, n, indices[k])) continue;
+				if(k + 1 == steps.size()) matched = true;
+				else next |= bit(k + 1);
+			}
+			return n.ckinfo.header.isContainer() ? next : 0;
+		}
+		void computeIndices(StateSet states, const RiffNode& n, size_t* indices) const
+		{
+			for(size_t k = 0; k < steps.size(); ++k)
+			{
+				indices[k] = 0;
+				if(!(states & bit(k)) || !steps[k].hasIndex || !n.parent) continue;
+				for(const auto& ns : n.parent->subnodes)
+				{
+					if(&ns == &n) break;
+					if(nameMatches(steps[k], ns)) ++indices[k];
+				}
+			}
+		}
+		void selectRecursive(const RiffNode& n, StateSet states, const size_t* indices, const std::function<void(const RiffNode&)>& callback) const
+		{
+			bool matched = false;
+			StateSet next = advance(states, n, indices, matched);
+			if(matched) callback(n);
+			if(!next) return;
+			std::vector<size_t> counters(steps.size(), 0), subindices(steps.size(), 0);
+			for(const auto& ns : n.subnodes)
+			{
+				for(size_t k = 0; k < steps.size(); ++k)
+				{
+					if((next & bit(k)) && steps[k].hasIndex && nameMatches(steps[k], ns)) subindices[k] = counters[k]++;
+				}
+				selectRecursive(ns, next, subindices.data(), callback);
+			}
+		}
+		// the states for the subnodes of n, evaluated along the path from the root
+		StateSet statesFor(const RiffNode& n, bool& matched) const
+		{
+			std::list<const RiffNode*> chain;
+			for(const RiffNode* pn = &n; pn; pn = pn->parent) chain.push_front(pn);
+			StateSet states = bit(0);
+			std::vector<size_t> indices(steps.size(), 0);
+			matched = false;
+			for(const RiffNode* pn : chain)
+			{
+				if(!states) return 0;
+				computeIndices(states, *pn, indices.data());
+				states = advance(states, *pn, indices.data(), matched);
+			}
+			return states;
+		}
+	public:
+		Query() = default;
+		Query(const std::string& s)
+		{
+			compile(s);
+		}
+		bool compile(const std::string& s)
+		{
+			steps.clear();
+			error.clear();
+			size_t pos = 0;
+			bool descendant = true;
+			if(s.compare(0, 2, "//") == 0) pos = 2;
+			else if(s.compare(0, 1, "/") == 0) { pos = 1; descendant = false; }
+			while(true)
+			{
+				Step st;
+				st.descendant = descendant;
+				if(!parseStep(s, pos, &st)) break;
+				steps.push_back(st);
+				if(pos == s.size()) break;
+				if(s.compare(pos, 2, "//") == 0) { pos += 2; descendant = true; }
+				else if(s[pos] == '/') { pos += 1; descendant = false; }
+				else { error = "unexpected character at " + std::to_string(pos); break; }
+			}
+			if(error.empty() && (MaxSteps < steps.size())) error = "too many steps";
+			if(!error.empty()) steps.clear();
+			return isValid();
+		}
+		bool isValid() const
+		{
+			return error.empty() && !steps.empty();
+		}
+		const std::string& getError() const
+		{
+			return error;
+		}
+		// pruned traversal: subtrees that cannot contain a match are not visited
+		void select(const RiffNode& root, const std::function<void(const RiffNode&)>& callback) const
+		{
+			if(!isValid()) return;
+			std::vector<size_t> indices(steps.size(), 0);
+			selectRecursive(root, bit(0), indices.data(), callback);
+		}
+		std::vector<const RiffNode*> selectNodes(const RiffNode& root) const
+		{
+			std::vector<const RiffNode*> nodes;
+			select(root, [&nodes](const RiffNode& n) { nodes.push_back(&n); });
+			return nodes;
+		}
+		bool matches(const RiffNode& n) const
+		{
+			bool matched = false;
+			if(isValid()) statesFor(n, matched);
+			return matched;
+		}
+		bool mayMatchBelow(const RiffNode& n) const
+		{
+			bool matched = false;
+			return isValid() && statesFor(n, matched);
+		}
+		// for RiffNode::readTree: containers that cannot contain a match are skipped without being parsed
+		// each filter keeps the evaluation state of one parse, so take a new one for each parse
+		RiffNode::DescendFilter descendFilter() const;
+	};
+
+	// incremental evaluation during a parse: the subnodes of a container are appended in order,
+	// so the states of each container and the per step sibling counters are kept and advanced by one sibling at a time
+	class QueryDescendEvaluator
+	{
+	protected:
+		struct Frame
+		{
+			Query::StateSet states = 0; // the states for the subnodes
+			std::vector<size_t> counters; // per step, the subnodes counted so far that pass the name test
+			std::list<RiffNode>::const_iterator last; // the last subnode counted, valid if numCounted != 0
+			size_t numCounted = 0;
+		};
+		Query query;
+		std::unordered_map<const RiffNode*, Frame> frames;
+		std::mutex mutex;
+		Frame& addFrame(const RiffNode& n, Query::StateSet states)
+		{
+			Frame& fr = frames[&n];
+			fr.states = states;
+			fr.counters.assign(query.steps.size(), 0);
+			return fr;
+		}
+	public:
+		QueryDescendEvaluator(const Query& q) : query(q)
+		{
+		}
+		bool mayMatchBelow(const RiffNode& n)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto itself = frames.find(&n);
+			if(itself != frames.end()) return itself->second.states != 0;
+			const size_t numsteps = query.steps.size();
+			std::vector<size_t> indices(numsteps, 0);
+			bool matched = false;
+			if(!n.parent) return addFrame(n, query.advance(Query::bit(0), n, indices.data(), matched)).states != 0;
+			auto itparent = frames.find(n.parent);
+			if(itparent == frames.end())
+			{
+				// the parent was not evaluated by this instance: evaluate it from the root once
+				addFrame(*n.parent, query.statesFor(*n.parent, matched));
+				itparent = frames.find(n.parent);
+			}
+			Frame& fr = itparent->second;
+			if(!fr.states) return addFrame(n, 0).states != 0;
+			const std::list<RiffNode>& siblings = n.parent->subnodes;
+			bool found = false;
+			for(auto it = fr.numCounted ? std::next(fr.last) : siblings.begin(); !found && (it != siblings.end()); ++it)
+			{
+				const RiffNode& ns = *it;
+				found = (&ns == &n);
+				fr.last = it;
+				++fr.numCounted;
+				for(size_t k = 0; k < numsteps; ++k)
+				{
+					if(!(fr.states & Query::bit(k)) || !query.steps[k].hasIndex || !Query::nameMatches(query.steps[k], ns)) continue;
+					if(found) indices[k] = fr.counters[k];
+					++fr.counters[k];
+				}
+			}
+			// not among the subnodes appended since the last call: count from the start
+			if(!found) query.computeIndices(fr.states, n, indices.data());
+			return addFrame(n, query.advance(fr.states, n, indices.data(), matched)).states != 0;
+		}
+	};
+
+	inline RiffNode::DescendFilter Query::descendFilter() const
+	{
+		std::shared_ptr<QueryDescendEvaluator> evaluator = std::make_shared<QueryDescendEvaluator>(*this);
+		return [evaluator](const RiffNode& n) { return evaluator->mayMatchBelow(n); };
+	}
+
+} // namespace riffrw
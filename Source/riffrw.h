@@ -7,34 +7,67 @@
 
 #pragma once
 
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <vector>
 #include <list>
 #include <functional>
+#include <memory>
+#include <thread>
+#include <atomic>
 
 namespace riffrw
 {
 
+	// a four character code as stored in the file (little endian), usable in constant expressions and case labels
+	struct FourCC
+	{
+		uint32_t value;
+		constexpr FourCC(uint32_t v = 0) : value(v)
+		{
+		}
+		constexpr FourCC(const char (&s)[5]) : value((uint32_t)(uint8_t)s[0] | ((uint32_t)(uint8_t)s[1] << 8) | ((uint32_t)(uint8_t)s[2] << 16) | ((uint32_t)(uint8_t)s[3] << 24))
+		{
+		}
+		constexpr operator uint32_t() const
+		{
+			return value;
+		}
+		static FourCC fromChars(const char* p)
+		{
+			uint32_t v;
+			std::memcpy(&v, p, 4);
+			return FourCC(v);
+		}
+		std::string toString() const
+		{
+			char s[4] = { (char)value, (char)(value >> 8), (char)(value >> 16), (char)(value >> 24) };
+			return std::string(s, 4);
+		}
+	};
+
 	struct ChunkHeader
 	{
 		uint32_t ckid;
 		uint32_t cksize;
 		bool isContainer() const
 		{
-			return (ckid == *(uint32_t*)"RIFF") || (ckid == *(uint32_t*)"LIST");
+			return (ckid == FourCC("RIFF")) || (ckid == FourCC("LIST"));
 		}
 	};
 
 	struct ChunkInfo
 	{
+		// chunks are word aligned, so this never is a real offset; marks an offset beyond 4 GiB that does not fit in hdroffset
+		static constexpr uint32_t OffsetOverflow = 0xffffffff;
 		uint32_t hdroffset;
 		ChunkHeader header;
 		uint32_t type;
 		std::string pathElement() const
 		{
-			std::string s = std::string((const char*)&header.ckid, 4);
-			if(header.isContainer()) s += std::string(".") + std::string((const char*)&type, 4);
+			std::string s = FourCC(header.ckid).toString();
+			if(header.isContainer()) s += "." + FourCC(type).toString();
 			return s;
 		}
 	};
@@ -92,6 +125,126 @@ namespace riffrw
 		}
 	};
 
+	// forward-only, event driven parser for non-seekable input (pipes, sockets, stdin)
+	// never calls seekg/tellg: offsets are tracked by counting consumed bytes, payloads are skipped by reading them
+	// memory usage is constant: a fixed transfer buffer and the stack of the currently open containers
+	// offsets are 64 bit (OpenDML input continues past 4 GiB), ChunkInfo::hdroffset is OffsetOverflow where it does not fit
+	class RiffStreamParser
+	{
+	protected:
+		struct OpenChunk
+		{
+			ChunkInfo ck;
+			uint64_t hdroffset;
+			uint64_t end; // padded
+		};
+		std::vector<char> buffer;
+		std::vector<OpenChunk> ckstack;
+		uint64_t position = 0;
+		bool truncated = false;
+		static uint64_t paddedEnd(uint64_t hdroffset, const ChunkInfo& ck)
+		{
+			return (hdroffset + 8 + ck.header.cksize + 1) & ~(uint64_t)0x01;
+		}
+		bool readBytes(std::istream& istr, void* p, size_t c)
+		{
+			istr.read((char*)p, c);
+			position += (uint64_t)istr.gcount();
+			if((size_t)istr.gcount() == c) return true;
+			truncated = true;
+			return false;
+		}
+		// consumes len bytes, handing them to onChunkData if ck is given
+		bool consumeBytes(std::istream& istr, uint64_t len, const ChunkInfo* ck)
+		{
+			while(0 < len)
+			{
+				size_t lseg = (size_t)std::min(len, (uint64_t)buffer.size());
+				if(!readBytes(istr, buffer.data(), lseg)) return false;
+				if(ck && onChunkData && !onChunkData(*ck, buffer.data(), lseg)) return false;
+				len -= lseg;
+			}
+			return true;
+		}
+		// the pad byte of an odd sized chunk; missing at the end of the input it is accepted, as the seekable reader does
+		bool consumePad(std::istream& istr)
+		{
+			char pad;
+			istr.read(&pad, 1);
+			if(istr.gcount() == 1) { ++position; return true; }
+			if(istr.eof()) return true;
+			truncated = true;
+			return false;
+		}
+		bool closeContainer(std::istream& istr)
+		{
+			OpenChunk oc = ckstack.back();
+			uint64_t end = oc.hdroffset + 8 + oc.ck.header.cksize;
+			if(position < end && !consumeBytes(istr, end - position, nullptr)) return false;
+			if(position < oc.end && !consumePad(istr)) return false;
+			ckstack.pop_back();
+			return !onChunkEnd || onChunkEnd(oc.ck, oc.hdroffset, (int)ckstack.size());
+		}
+	public:
+		// onChunkBegin: set wantData to receive the payload of a non-container chunk through onChunkData
+		// hdroffset is the full offset of the chunk header; every callback may return false to stop parsing
+		std::function<bool(const ChunkInfo& ck, uint64_t hdroffset, int depth, bool& wantData)> onChunkBegin;
+		std::function<bool(const ChunkInfo& ck, const void* p, size_t c)> onChunkData;
+		std::function<bool(const ChunkInfo& ck, uint64_t hdroffset, int depth)> onChunkEnd;
+		RiffStreamParser(size_t buffersize = 65536) : buffer(buffersize)
+		{
+		}
+		uint64_t getPosition() const
+		{
+			return position;
+		}
+		bool wasTruncated() const
+		{
+			return truncated;
+		}
+		// parses consecutive top level chunks until the end of the input (e.g. OpenDML RIFF AVIX segments)
+		// returns false if the input ends inside a chunk or a callback stopped the parsing, not if it ends at a missing pad byte
+		bool parse(std::istream& istr, bool firstChunkOnly = false)
+		{
+			position = 0;
+			truncated = false;
+			ckstack.clear();
+			while(true)
+			{
+				while(!ckstack.empty() && (ckstack.back().end < position + 8))
+				{
+					if(!closeContainer(istr)) return false;
+					if(firstChunkOnly && ckstack.empty()) return true;
+				}
+				uint64_t hdroffset = position;
+				ChunkInfo ck = {};
+				ck.hdroffset = (hdroffset < ChunkInfo::OffsetOverflow) ? (uint32_t)hdroffset : ChunkInfo::OffsetOverflow;
+				istr.read((char*)&ck.header, 8);
+				size_t lhdr = (size_t)istr.gcount();
+				position += lhdr;
+				if(lhdr == 0 && ckstack.empty()) return true;
+				if(lhdr < 8) { truncated = true; return false; }
+				if(ck.header.isContainer())
+				{
+					if(!readBytes(istr, &ck.type, 4)) return false;
+					bool wantData = false;
+					if(onChunkBegin && !onChunkBegin(ck, hdroffset, (int)ckstack.size(), wantData)) return false;
+					ckstack.push_back({ ck, hdroffset, paddedEnd(hdroffset, ck) });
+				}
+				else
+				{
+					int depth = (int)ckstack.size();
+					bool wantData = false;
+					if(onChunkBegin && !onChunkBegin(ck, hdroffset, depth, wantData)) return false;
+					if(!consumeBytes(istr, ck.header.cksize, wantData ? &ck : nullptr)) return false;
+					if((ck.header.cksize & 0x01) && !consumePad(istr)) return false;
+					if(onChunkEnd && !onChunkEnd(ck, hdroffset, depth)) return false;
+					if(firstChunkOnly && ckstack.empty()) return true;
+				}
+			}
+		}
+	};
+
 	class RiffWriter
 	{
 	protected:
@@ -115,7 +268,7 @@ namespace riffrw
 		}
 		bool descend(const char* ckid, const char* type_or_z = nullptr)
 		{
-			return descend(*(uint32_t*)ckid, type_or_z ? *(uint32_t*)type_or_z : 0);
+			return descend(FourCC::fromChars(ckid), type_or_z ? FourCC::fromChars(type_or_z) : FourCC());
 		}
 		bool descend(uint32_t ckid, uint32_t type_or_z = 0)
 		{
@@ -173,6 +326,30 @@ namespace riffrw
 		RiffNode* parent = 0;
 		std::list<RiffNode> subnodes;
 		RiffNode() = default;
+		RiffNode(const RiffNode& o) : ckinfo(o.ckinfo), subnodes(o.subnodes)
+		{
+			relinkSubNodes();
+		}
+		RiffNode(RiffNode&& o) noexcept : ckinfo(o.ckinfo), subnodes(std::move(o.subnodes))
+		{
+			relinkSubNodes();
+		}
+		RiffNode& operator=(const RiffNode& o)
+		{
+			if(this == &o) return *this;
+			ckinfo = o.ckinfo;
+			subnodes = o.subnodes;
+			relinkSubNodes();
+			return *this;
+		}
+		RiffNode& operator=(RiffNode&& o) noexcept
+		{
+			if(this == &o) return *this;
+			ckinfo = o.ckinfo;
+			subnodes = std::move(o.subnodes);
+			relinkSubNodes();
+			return *this;
+		}
 		RiffNode(uint32_t uckid, uint32_t utype = 0)
 		{
 			ckinfo.header.ckid = uckid;
@@ -180,8 +357,8 @@ namespace riffrw
 		}
 		RiffNode(const char* sckid, const char* stype = nullptr)
 		{
-			ckinfo.header.ckid = *(uint32_t*)sckid;
-			if(stype) ckinfo.type = *(uint32_t*)stype;
+			ckinfo.header.ckid = FourCC::fromChars(sckid);
+			if(stype) ckinfo.type = FourCC::fromChars(stype);
 		}
 		std::string nodePath() const
 		{
@@ -191,6 +368,11 @@ namespace riffrw
 			for(const auto& e : elist) path += "/" + e;
 			return path;
 		}
+		// the parent pointers of the direct subnodes must follow the node when it is copied or moved
+		void relinkSubNodes()
+		{
+			for(auto& ns : subnodes) ns.parent = this;
+		}
 		RiffNode& addSubNode(const RiffNode& nsadd)
 		{
 			subnodes.push_back(nsadd);
@@ -199,15 +381,20 @@ namespace riffrw
 			return nsnew;
 		}
 		// recursive r/w
-		static bool readTree(RiffReader& reader, RiffNode* pn)
+		// descendFilter: return false to leave a container unparsed (its subnodes stay empty and it is skipped as a whole)
+		using DescendFilter = std::function<bool(const RiffNode& n)>;
+		// called for each chunk as soon as its header is read, before its subnodes, depth 0 is the top level chunk; return false to abort the read
+		using ChunkObserver = std::function<bool(const RiffNode& n, int depth)>;
+		static bool readTree(RiffReader& reader, RiffNode* pn, const DescendFilter& descendFilter = nullptr, const ChunkObserver& observer = nullptr, int depth = 0)
 		{
 			if(!reader.descend(&pn->ckinfo)) return false;
-			if(pn->ckinfo.header.isContainer())
+			if(observer && !observer(*pn, depth)) return false;
+			if(pn->ckinfo.header.isContainer() && (!descendFilter || descendFilter(*pn)))
 			{
 				while(reader.canDescend())
 				{
 					RiffNode& ns = pn->addSubNode({});
-					if(!readTree(reader, &ns)) return false;
+					if(!readTree(reader, &ns, descendFilter, observer, depth + 1)) return false;
 				}
 			}
 			if(!reader.ascend()) return false;
@@ -236,12 +423,86 @@ namespace riffrw
 			RiffReader reader(istr);
 			return readTree(reader, pn);
 		}
+		// for non-seekable input; fails on a chunk beyond 4 GiB, which the tree cannot address
+		static bool readTreeFromForwardStream(std::istream& istr, RiffNode* pn)
+		{
+			RiffStreamParser parser;
+			RiffNode* pcur = nullptr;
+			parser.onChunkBegin = [pn, &pcur](const ChunkInfo& ck, uint64_t, int, bool&)
+			{
+				if(ck.hdroffset == ChunkInfo::OffsetOverflow) return false;
+				pcur = pcur ? &pcur->addSubNode({}) : pn;
+				pcur->ckinfo = ck;
+				return true;
+			};
+			parser.onChunkEnd = [pn, &pcur](const ChunkInfo&, uint64_t, int)
+			{
+				pcur = (pcur == pn) ? nullptr : pcur->parent;
+				return true;
+			};
+			return parser.parse(istr, true) && (pcur == nullptr);
+		}
 		static bool readTreeFromFile(const std::filesystem::path& path, RiffNode* pn)
 		{
 			std::fstream istr(path, std::ios::in | std::ios::binary);
 			if(!istr.good()) return false;
 			return readTreeFromStream(istr, pn);
 		}
+		// parallel read
+		// the top level chunk is walked down to its direct subnodes, then the container subnodes are parsed on a worker pool
+		// each worker has an independent stream supplied by the factory, the results are stitched in place
+		// the observer factory is called once on each thread taking part (concurrently), each observer is only called from its own thread
+		using StreamFactory = std::function<std::unique_ptr<std::istream>()>;
+		using ObserverFactory = std::function<ChunkObserver()>;
+		static bool readTreeParallel(const StreamFactory& openStream, RiffNode* pn, unsigned int numThreads = 0, const DescendFilter& descendFilter = nullptr, const ObserverFactory& makeObserver = nullptr)
+		{
+			std::vector<RiffNode*> jobs;
+			{
+				std::unique_ptr<std::istream> istr = openStream();
+				if(!istr || !istr->good()) return false;
+				ChunkObserver observer = makeObserver ? makeObserver() : nullptr;
+				RiffReader reader(*istr);
+				if(!reader.descend(&pn->ckinfo)) return false;
+				if(observer && !observer(*pn, 0)) return false;
+				if(pn->ckinfo.header.isContainer() && (!descendFilter || descendFilter(*pn)))
+				{
+					while(reader.canDescend())
+					{
+						RiffNode& ns = pn->addSubNode({});
+						if(!reader.descend(&ns.ckinfo)) return false;
+						// the jobs are observed by the workers
+						if(ns.ckinfo.header.isContainer() && (!descendFilter || descendFilter(ns))) jobs.push_back(&ns);
+						else if(observer && !observer(ns, 1)) return false;
+						if(!reader.ascend()) return false;
+					}
+				}
+				if(!reader.ascend()) return false;
+			}
+			if(jobs.empty()) return true;
+			if(!numThreads) numThreads = std::max(1u, std::thread::hardware_concurrency());
+			numThreads = std::min(numThreads, (unsigned int)jobs.size());
+			std::atomic<size_t> inext{ 0 };
+			std::atomic<bool> ok{ true };
+			auto worker = [&]()
+			{
+				std::unique_ptr<std::istream> istr = openStream();
+				if(!istr || !istr->good()) { ok = false; return; }
+				ChunkObserver observer = makeObserver ? makeObserver() : nullptr;
+				RiffReader reader(*istr);
+				for(size_t i = inext++; ok && (i < jobs.size()); i = inext++)
+				{
+					RiffNode* pjob = jobs[i];
+					istr->clear();
+					istr->seekg(pjob->ckinfo.hdroffset);
+					if(!readTree(reader, pjob, descendFilter, observer, 1)) ok = false;
+				}
+			};
+			std::vector<std::thread> threads;
+			for(unsigned int i = 1; i < numThreads; ++i) threads.emplace_back(worker);
+			worker();
+			for(auto& t : threads) t.join();
+			return ok;
+		}
 		static bool writeTreeToStream(const RiffNode& n, std::ostream& ostr, std::function<bool(const RiffNode& n, RiffWriter& writer)> ckhandler)
 		{
 			RiffWriter writer(ostr);
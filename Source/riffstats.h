@@ -0,0 +1,231 @@
+//
+//  riffstats.h
+//  aggregate chunk statistics, accumulated while reading the tree
+//
+//  created by yu2924 on 2026-10-18
+//
+
+#pragma once
+
+#include "riffrw.h"
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <algorithm>
+#include <cstdio>
+
+namespace riffrw
+{
+
+	// log-linear histogram: exact below 8, then 8 buckets per octave, so a percentile is within 1/8 of an octave
+	struct SizeHistogram
+	{
+		enum { SubBits = 3, SubCount = 1 << SubBits, NumBuckets = SubCount * (64 - SubBits + 1) };
+		uint64_t buckets[NumBuckets] = {};
+		static int bucketOf(uint64_t v)
+		{
+			if(v < SubCount) return (int)v;
+			int e = 63;
+			while(!(v >> e)) --e;
+			return SubCount * (e - SubBits + 1) + (int)((v >> (e - SubBits)) & (SubCount - 1));
+		}
+		static uint64_t lowerBound(int i)
+		{
+			if(i < SubCount) return (uint64_t)i;
+			int e = i / SubCount + SubBits - 1;
+			return (uint64_t)(SubCount + i % SubCount) << (e - SubBits);
+		}
+		static uint64_t upperBound(int i)
+		{
+			if(i < SubCount) return (uint64_t)i;
+			int e = i / SubCount + SubBits - 1;
+			return lowerBound(i) + ((uint64_t)1 << (e - SubBits)) - 1;
+		}
+		void add(uint64_t v)
+		{
+			++buckets[bucketOf(v)];
+		}
+		void merge(const SizeHistogram& o)
+		{
+			for(int i = 0; i < NumBuckets; ++i) buckets[i] += o.buckets[i];
+		}
+		// q in [0, 1], interpolated linearly inside the bucket
+		uint64_t percentile(double q, uint64_t count) const
+		{
+			if(!count) return 0;
+			double rank = q * (double)(count - 1);
+			uint64_t cum = 0;
+			for(int i = 0; i < NumBuckets; ++i)
+			{
+				if(!buckets[i]) continue;
+				if(rank < (double)(cum + buckets[i]))
+				{
+					double frac = (rank - (double)cum + 0.5) / (double)buckets[i];
+					return lowerBound(i) + (uint64_t)(frac * (double)(upperBound(i) - lowerBound(i)));
+				}
+				cum += buckets[i];
+			}
+			return 0;
+		}
+	};
+
+	// per chunk kind statistics and anomalies, mergeable across threads and files
+	struct ChunkStats
+	{
+		struct Entry
+		{
+			uint64_t count = 0;
+			uint64_t total = 0;
+			uint64_t min = UINT64_MAX;
+			uint64_t max = 0;
+			SizeHistogram histogram;
+			void add(uint64_t v)
+			{
+				++count;
+				total += v;
+				min = std::min(min, v);
+				max = std::max(max, v);
+				histogram.add(v);
+			}
+			void merge(const Entry& o)
+			{
+				count += o.count;
+				total += o.total;
+				min = std::min(min, o.min);
+				max = std::max(max, o.max);
+				histogram.merge(o.histogram);
+			}
+			uint64_t percentile(double q) const
+			{
+				return std::clamp(histogram.percentile(q, count), min, max);
+			}
+		};
+		std::map<uint64_t, Entry> entries; // ckid, and the list type in the upper half for containers
+		uint64_t numFiles = 0;
+		uint64_t numFailed = 0;
+		uint64_t numChunks = 0;
+		uint64_t headerBytes = 0;
+		uint64_t paddingBytes = 0;
+		int maxDepth = 0;
+		uint64_t numOddSize = 0;
+		uint64_t numMissingPad = 0;		// odd sized chunk whose pad byte lies outside the parent or the file
+		uint64_t numOutOfBounds = 0;	// chunk extending beyond its parent or the file
+		static uint64_t keyOf(const ChunkInfo& ck)
+		{
+			return ck.header.isContainer() ? (((uint64_t)ck.type << 32) | ck.header.ckid) : ck.header.ckid;
+		}
+		static std::string nameOf(uint64_t key)
+		{
+			ChunkInfo ck = {};
+			ck.header.ckid = (uint32_t)key;
+			ck.type = (uint32_t)(key >> 32);
+			return ck.pathElement();
+		}
+		// limit: the end of the parent payload, or of the stream for a top level chunk
+		void add(const ChunkInfo& ck, uint64_t hdroffset, int depth, uint64_t limit)
+		{
+			entries[keyOf(ck)].add(ck.header.cksize);
+			++numChunks;
+			headerBytes += ck.header.isContainer() ? 12 : 8;
+			maxDepth = std::max(maxDepth, depth);
+			uint64_t end = hdroffset + 8 + ck.header.cksize;
+			if(limit < end) ++numOutOfBounds;
+			if(ck.header.cksize & 1) ++numOddSize;
+		}
+		// the pad byte of an odd sized chunk counts as padding if it lies inside the limit and was there to read
+		void addPad(const ChunkInfo& ck, uint64_t hdroffset, uint64_t limit, bool padRead)
+		{
+			if(!(ck.header.cksize & 1)) return;
+			uint64_t end = hdroffset + 8 + ck.header.cksize;
+			if((end < limit) && padRead) ++paddingBytes;
+			else if(end <= limit) ++numMissingPad;
+		}
+		void add(const RiffNode& n, int depth, uint64_t streamsize)
+		{
+			uint64_t limit = n.parent ? ((uint64_t)n.parent->ckinfo.hdroffset + 8 + n.parent->ckinfo.header.cksize) : streamsize;
+			limit = std::min(limit, streamsize);
+			add(n.ckinfo, n.ckinfo.hdroffset, depth, limit);
+			addPad(n.ckinfo, n.ckinfo.hdroffset, limit, true);
+		}
+		void merge(const ChunkStats& o)
+		{
+			for(const auto& e : o.entries) entries[e.first].merge(e.second);
+			numFiles += o.numFiles;
+			numFailed += o.numFailed;
+			numChunks += o.numChunks;
+			headerBytes += o.headerBytes;
+			paddingBytes += o.paddingBytes;
+			maxDepth = std::max(maxDepth, o.maxDepth);
+			numOddSize += o.numOddSize;
+			numMissingPad += o.numMissingPad;
+			numOutOfBounds += o.numOutOfBounds;
+		}
+		// reads the tree with one accumulator per thread and merges them into this
+		// shouldExit is polled for each chunk, returning true aborts the read
+		bool readTree(const RiffNode::StreamFactory& openStream, uint64_t streamsize, RiffNode* pn, unsigned int numThreads = 0, const std::function<bool()>& shouldExit = nullptr)
+		{
+			std::mutex mutex;
+			std::list<ChunkStats> locals;
+			bool ok = RiffNode::readTreeParallel(openStream, pn, numThreads, nullptr, [&]() -> RiffNode::ChunkObserver
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				ChunkStats* ps = &locals.emplace_back();
+				return [ps, streamsize, &shouldExit](const RiffNode& n, int depth)
+				{
+					if(shouldExit && shouldExit()) return false;
+					ps->add(n, depth, streamsize);
+					return true;
+				};
+			});
+			for(const auto& s : locals) merge(s);
+			++numFiles;
+			if(!ok) ++numFailed;
+			return ok;
+		}
+		// forward-only input (stdin, pipes): all top level chunks, including OpenDML RIFF AVIX segments past 4 GiB
+		// the stream size is unknown, a chunk running past the end of the input shows up as a truncated (failed) file
+		// the pad byte is judged at the end of the chunk, when the parser has read it or met the end of the input
+		bool readStream(std::istream& istr)
+		{
+			RiffStreamParser parser;
+			std::vector<uint64_t> ends;
+			parser.onChunkBegin = [this, &ends](const ChunkInfo& ck, uint64_t hdroffset, int depth, bool&)
+			{
+				add(ck, hdroffset, depth, ends.empty() ? UINT64_MAX : ends.back());
+				if(ck.header.isContainer()) ends.push_back(hdroffset + 8 + ck.header.cksize);
+				return true;
+			};
+			parser.onChunkEnd = [this, &ends, &parser](const ChunkInfo& ck, uint64_t hdroffset, int)
+			{
+				if(ck.header.isContainer()) ends.pop_back();
+				addPad(ck, hdroffset, ends.empty() ? UINT64_MAX : ends.back(), hdroffset + 8 + ck.header.cksize < parser.getPosition());
+				return true;
+			};
+			bool ok = parser.parse(istr);
+			++numFiles;
+			if(!ok) ++numFailed;
+			return ok;
+		}
+		void report(std::ostream& ostr) const
+		{
+			char line[256];
+			std::snprintf(line, sizeof(line), "files: %llu (%llu failed), chunks: %llu, max depth: %d\n", (unsigned long long)numFiles, (unsigned long long)numFailed, (unsigned long long)numChunks, maxDepth);
+			ostr << line;
+			std::snprintf(line, sizeof(line), "header bytes: %llu, padding bytes: %llu\n", (unsigned long long)headerBytes, (unsigned long long)paddingBytes);
+			ostr << line;
+			std::snprintf(line, sizeof(line), "odd size: %llu, missing pad: %llu, out of bounds: %llu\n", (unsigned long long)numOddSize, (unsigned long long)numMissingPad, (unsigned long long)numOutOfBounds);
+			ostr << line;
+			std::snprintf(line, sizeof(line), "%-10s %10s %14s %10s %10s %10s %10s %10s\n", "chunk", "count", "total", "min", "p50", "p90", "p99", "max");
+			ostr << line;
+			for(const auto& e : entries)
+			{
+				const Entry& en = e.second;
+				std::snprintf(line, sizeof(line), "%-10s %10llu %14llu %10llu %10llu %10llu %10llu %10llu\n", nameOf(e.first).c_str(),
+					(unsigned long long)en.count, (unsigned long long)en.total, (unsigned long long)en.min,
+					(unsigned long long)en.percentile(0.5), (unsigned long long)en.percentile(0.9), (unsigned long long)en.percentile(0.99), (unsigned long long)en.max);
+				ostr << line;
+			}
+		}
+	};
+
+} // namespace riffrw